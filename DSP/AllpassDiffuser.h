@@ -28,6 +28,8 @@ THE SOFTWARE.
 
 namespace Cloudseed
 {
+	// T is the sample type, TStorage the type the history is stored as, see SampleStorage
+	template<typename T, typename TStorage = T>
 	class AllpassDiffuser
 	{
 	public:
@@ -36,19 +38,23 @@ namespace Cloudseed
 	private:
 		int samplerate;
 
-		ModulatedAllpass filters[MaxStageCount];
+		ModulatedAllpass<T, TStorage> filters[MaxStageCount];
 		int delay;
+		float modAmount;
 		float modRate;
-		std::vector<float> seedValues;
+		RandomSeries<MaxStageCount * 3> seedValues;
 		int seed;
-		float crossSeed;
+		CrossSeed crossSeed;
 
 	public:
 		int Stages;
 
 		AllpassDiffuser()
 		{
-			crossSeed = 0.0;
+			delay = 100;
+			modAmount = 0;
+			modRate = 0;
+			samplerate = 48000;
 			seed = 23456;
 			UpdateSeeds();
 			Stages = 1;
@@ -64,7 +70,16 @@ namespace Cloudseed
 		void SetSamplerate(int samplerate)
 		{
 			this->samplerate = samplerate;
-			SetModRate(modRate);
+			Update();
+		}
+
+		// The buffer is owned by the caller and holds MaxStageCount * sizePerStage values,
+		// sizePerStage being at least ModulatedAllpass::GetBufferSize() for the longest stage.
+		// resampleRatio carries the history over, see ModulatedAllpass::SetBuffer
+		void SetBuffer(TStorage* buffer, int sizePerStage, double resampleRatio = 0)
+		{
+			for (int i = 0; i < MaxStageCount; i++)
+				filters[i].SetBuffer(&buffer[i * sizePerStage], sizePerStage, resampleRatio);
 		}
 
 		void SetSeed(int seed)
@@ -73,13 +88,28 @@ namespace Cloudseed
 			UpdateSeeds();
 		}
 
-		void SetCrossSeed(float crossSeed)
+		void SetCrossSeed(const CrossSeed& crossSeed)
 		{
 			this->crossSeed = crossSeed;
 			UpdateSeeds();
 		}
 
 
+		// Takes over the seeds, delays and modulation of another diffuser, keeping this diffuser's buffers and LFO phases
+		void CopySettings(const AllpassDiffuser& source)
+		{
+			for (int i = 0; i < MaxStageCount; i++)
+				filters[i].CopySettings(source.filters[i]);
+			samplerate = source.samplerate;
+			delay = source.delay;
+			modAmount = source.modAmount;
+			modRate = source.modRate;
+			seedValues = source.seedValues;
+			seed = source.seed;
+			crossSeed = source.crossSeed;
+			Stages = source.Stages;
+		}
+
 		bool GetModulationEnabled()
 		{
 			return filters[0].ModulationEnabled;
@@ -112,28 +142,36 @@ namespace Cloudseed
 
 		void SetModAmount(float amount)
 		{
-			for (int i = 0; i < MaxStageCount; i++)
-				filters[i].ModAmount = amount * (0.85 + 0.3 * seedValues[MaxStageCount + i]);
+			modAmount = amount;
+			Update();
 		}
 
 		void SetModRate(float rate)
 		{
 			modRate = rate;
+			Update();
+		}
 
+		void SetModulationUpdateRate(int samples)
+		{
 			for (int i = 0; i < MaxStageCount; i++)
-				filters[i].ModRate = rate * (0.85 + 0.3 * seedValues[MaxStageCount * 2 + i]) / samplerate;
+				filters[i].SetModulationUpdateRate(samples);
 		}
 
-		void Process(float* input, float* output, int bufSize)
+		// Draws the starting phase of every stage from random, in stage order
+		void RandomizeModPhases(LcgRandom& random)
 		{
-			float tempBuffer[BUFFER_SIZE];
+			for (int i = 0; i < MaxStageCount; i++)
+				filters[i].RandomizeModPhase(random);
+		}
 
-			filters[0].Process(input, tempBuffer, bufSize);
+		// Works in place, every stage after the first runs on the output buffer
+		void Process(const T* input, T* output, int bufSize)
+		{
+			filters[0].Process(input, output, bufSize);
 
 			for (int i = 1; i < Stages; i++)
-				filters[i].Process(tempBuffer, tempBuffer, bufSize);
-			
-			Utils::Copy(output, tempBuffer, bufSize);
+				filters[i].Process(output, output, bufSize);
 		}
 
 		void ClearBuffers()
@@ -142,7 +180,22 @@ namespace Cloudseed
 				filters[i].ClearBuffers();
 		}
 
+		// Every stage, including the ones not in use, which still hold their history for when they are switched back on
+		void SaveState(StateWriter& writer)
+		{
+			for (int i = 0; i < MaxStageCount; i++)
+				filters[i].SaveState(writer);
+		}
+
+		void LoadState(StateReader& reader)
+		{
+			for (int i = 0; i < MaxStageCount; i++)
+				filters[i].LoadState(reader);
+		}
+
 	private:
+		// Spreads the delay, mod amount and mod rate over the stages by the seed values, so a new seed
+		// moves all three, whichever order they were set in
 		void Update()
 		{
 			for (int i = 0; i < MaxStageCount; i++)
@@ -150,13 +203,16 @@ namespace Cloudseed
 				auto r = seedValues[i];
 				auto d = std::pow(10, r) * 0.1; // 0.1 ... 1.0
 				filters[i].SampleDelay = (int)(delay * d);
+				filters[i].ModAmount = modAmount * (0.85 + 0.3 * seedValues[MaxStageCount + i]);
+				filters[i].SetModRate(modRate * (0.85 + 0.3 * seedValues[MaxStageCount * 2 + i]) / samplerate);
+				filters[i].UpdateReadIndex();
 			}
 		}
 
 		void UpdateSeeds()
 		{
-			this->seedValues = RandomBuffer::Generate(seed, MaxStageCount * 3, crossSeed);
-			Update();
+			if (seedValues.Generate(seed, MaxStageCount * 3, crossSeed))
+				Update();
 		}
 
 	};
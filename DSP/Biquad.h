@@ -71,6 +71,16 @@ namespace Cloudseed
 
 		double GetResponse(float freq) const;
 
+		// Normalised coefficients, used by filter banks that run several biquads side by side
+		void GetCoefficients(float& b0, float& b1, float& b2, float& a1, float& a2) const
+		{
+			b0 = this->b0;
+			b1 = this->b1;
+			b2 = this->b2;
+			a1 = this->a1;
+			a2 = this->a2;
+		}
+
 		float inline Process(float x)
 		{
 			y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
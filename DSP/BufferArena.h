@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Cloudseed
+{
+	// One block of memory that a reverb channel carves all of its delay buffers out of.
+	// The owner adds up the padded sizes of everything it needs, calls Reset() with the total, then hands out
+	// pieces with Allocate(). Every piece starts on a 64 byte boundary, and pieces of different types can share
+	// the block. The memory is kept when Reset() is called again with a smaller or equal total, so it is only
+	// reallocated when the requirement grows.
+	class BufferArena
+	{
+	public:
+		static const int Alignment = 64; // in bytes
+
+	private:
+		std::unique_ptr<uint8_t[]> storage;
+		uint8_t* base;
+		size_t capacity;
+		size_t used;
+
+	public:
+		BufferArena()
+		{
+			base = nullptr;
+			capacity = 0;
+			used = 0;
+		}
+
+		// Bytes taken up by count values of type T, including the padding up to the next piece
+		template<typename T = float>
+		static size_t Padded(size_t count)
+		{
+			return (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+		}
+
+		// In bytes
+		size_t GetCapacity()
+		{
+			return capacity;
+		}
+
+		// Bytes handed out since the last Reset()
+		size_t GetUsed()
+		{
+			return used;
+		}
+
+		// Zeroes bytes of the memory handed out, starting at offset, so a large arena can be cleared over several calls
+		void Zero(size_t offset, size_t bytes)
+		{
+			if (base != nullptr && bytes > 0)
+				memset(base + offset, 0, bytes);
+		}
+
+		// Discards all previous allocations and makes room for totalBytes, the sum of Padded() for every piece
+		void Reset(size_t totalBytes)
+		{
+			if (totalBytes > capacity)
+			{
+				storage.reset(new uint8_t[totalBytes + Alignment]);
+				auto address = (uintptr_t)storage.get();
+				base = (uint8_t*)((address + Alignment - 1) / Alignment * Alignment);
+				capacity = totalBytes;
+			}
+
+			used = 0;
+		}
+
+		// Returns uninitialised memory for count values, or nullptr if the arena was not reset with enough room
+		template<typename T = float>
+		T* Allocate(size_t count)
+		{
+			auto padded = Padded<T>(count);
+			if (used + padded > capacity)
+				return nullptr;
+
+			auto ptr = (T*)(base + used);
+			used += padded;
+			return ptr;
+		}
+	};
+}
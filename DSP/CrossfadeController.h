@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <memory>
+#include <cmath>
+#include "ReverbController.h"
+#include "ReverbPreset.h"
+#include "BufferArena.h"
+#include "StereoView.h"
+
+namespace Cloudseed
+{
+	// Two reverb engines, for program changes without a glitch. SetPreset loads the new program into the idle engine
+	// and fades over to it with an equal power crossfade, while the old program's tail fades out on the other engine.
+	// Only the active engine runs outside of a fade, so the cost doubles only while fading. After a fade, the engine
+	// that faded out is cleared a slice per block, so the next SetPreset finds it silent.
+	// T and TStorage are the sample and delay storage type, as for BasicReverbController.
+	template<typename T, typename TStorage = T>
+	class BasicCrossfadeController
+	{
+	public:
+		// Delay memory of the idle engine cleared per sample processed. At 48kHz or 96kHz the clear takes about half
+		// a second and adds around 15us to a block of 256 samples, where clearing at once costs 1 to 3ms.
+		static const size_t ClearBytesPerSample = 1024;
+
+	private:
+		typedef BasicReverbController<T, TStorage> Controller;
+		typedef BasicStereoView<T> View;
+
+		std::unique_ptr<Controller> engines[2];
+		int active;
+		int maxBlockSize;
+
+		// Scratch for the outgoing engine's output during a fade
+		BufferArena workspace;
+		T* fadeL;
+		T* fadeR;
+
+		// Gains of the incoming and outgoing engine, cos and sin of an angle going from pi/2 to 0 over the fade,
+		// advanced by a rotation every sample
+		int fadeRemaining;
+		double fadeIn;
+		double fadeOut;
+		double stepCos;
+		double stepSin;
+		bool clearing; // the idle engine still holds the tail it faded out, see ClearBytesPerSample
+
+	public:
+		// Both engines use the same seed, see ReverbController::SetSeed
+		BasicCrossfadeController(int samplerate, uint64_t seed = 0)
+		{
+			engines[0].reset(new Controller(samplerate, seed));
+			engines[1].reset(new Controller(samplerate, seed));
+			active = 0;
+			maxBlockSize = engines[0]->GetMaxBlockSize();
+			AllocateWorkspace();
+			fadeRemaining = 0;
+			fadeIn = 1;
+			fadeOut = 0;
+			stepCos = 1;
+			stepSin = 0;
+			clearing = false;
+		}
+
+		int GetSamplerate()
+		{
+			return engines[active]->GetSamplerate();
+		}
+
+		// Any setting other than the parameters, such as the late decimation or the sleep mode, has to be made
+		// on both engines. Index 0 and 1, see GetActiveIndex.
+		Controller& GetController(int index)
+		{
+			return *engines[index];
+		}
+
+		// The engine that is playing the current program
+		int GetActiveIndex()
+		{
+			return active;
+		}
+
+		bool IsFading()
+		{
+			return fadeRemaining > 0;
+		}
+
+		// True while a fade, or the clear of the idle engine after it, is still running. SetPreset then applies
+		// the preset without a fade.
+		bool IsBusy()
+		{
+			return fadeRemaining > 0 || clearing;
+		}
+
+		// Ends any fade and clears both engines, see ReverbController::SetSamplerate
+		void SetSamplerate(int samplerate)
+		{
+			engines[0]->SetSamplerate(samplerate);
+			engines[1]->SetSamplerate(samplerate);
+			fadeRemaining = 0;
+			clearing = false;
+		}
+
+		// Same as ReverbController::Prepare, for both engines
+		void Prepare(int maxBlockSize)
+		{
+			this->maxBlockSize = maxBlockSize < 1 ? 1 : maxBlockSize;
+			AllocateWorkspace();
+			engines[0]->Prepare(this->maxBlockSize);
+			engines[1]->Prepare(this->maxBlockSize);
+			fadeRemaining = 0;
+			clearing = false;
+		}
+
+		// Changes a parameter of the current program, on the active engine
+		void SetParameter(int paramId, double value)
+		{
+			engines[active]->SetParameter(paramId, value);
+		}
+
+		double* GetAllParameters()
+		{
+			return engines[active]->GetAllParameters();
+		}
+
+		// Applies the preset to the idle engine and fades over to it in fadeMillis. The idle engine is silent, so the
+		// new program only sounds for input from now on, while the old tail fades out. A preset set while IsBusy(),
+		// or with no fade time, is applied to the active engine straight away.
+		// Costs ApplyPreset only, nothing is allocated or cleared, so it is safe to call from the audio thread.
+		void SetPreset(const BasicReverbPreset<T, TStorage>& preset, float fadeMillis = 100)
+		{
+			int fadeSamples = (int)(fadeMillis * 0.001 * GetSamplerate());
+			if (IsBusy() || fadeSamples <= 0)
+			{
+				engines[active]->ApplyPreset(preset);
+				return;
+			}
+
+			int next = 1 - active;
+			engines[next]->ApplyPreset(preset);
+			active = next;
+
+			double step = M_PI / 2 / fadeSamples;
+			stepCos = std::cos(step);
+			stepSin = std::sin(step);
+			fadeIn = 0;
+			fadeOut = 1;
+			fadeRemaining = fadeSamples;
+		}
+
+		void ClearBuffers()
+		{
+			engines[0]->ClearBuffers();
+			engines[1]->ClearBuffers();
+			fadeRemaining = 0;
+			clearing = false;
+		}
+
+		// Same as ReverbController::Process
+		void Process(T* inL, T* inR, T* outL, T* outR, int bufSize)
+		{
+			Process(View::Planar(inL, inR), View::Planar(outL, outR), bufSize);
+		}
+
+		// Same as ReverbController::Process. The output may be the same memory as the input, laid out the same way.
+		void Process(const View& input, const View& output, int bufSize)
+		{
+			View in = input;
+			View out = output;
+			int totalSize = bufSize;
+
+			while (bufSize > 0 && fadeRemaining > 0)
+			{
+				int subBufSize = bufSize > maxBlockSize ? maxBlockSize : bufSize;
+				ProcessFade(in, out, subBufSize);
+				in = in.Offset(subBufSize);
+				out = out.Offset(subBufSize);
+				bufSize -= subBufSize;
+			}
+
+			if (bufSize > 0)
+				engines[active]->Process(in, out, bufSize);
+
+			if (clearing && fadeRemaining == 0)
+				clearing = !engines[1 - active]->ClearBuffersStep(totalSize * ClearBytesPerSample);
+		}
+
+	private:
+		void AllocateWorkspace()
+		{
+			workspace.Reset(2 * BufferArena::Padded<T>(maxBlockSize));
+			fadeL = workspace.Allocate<T>(maxBlockSize);
+			fadeR = workspace.Allocate<T>(maxBlockSize);
+		}
+
+		void ProcessFade(const View& in, const View& out, int bufSize)
+		{
+			// the outgoing engine reads the input before the active engine overwrites it, when processing in place
+			engines[1 - active]->Process(in, View::Planar(fadeL, fadeR), bufSize);
+			engines[active]->Process(in, out, bufSize);
+
+			int fadeSize = bufSize < fadeRemaining ? bufSize : fadeRemaining;
+			for (int i = 0; i < fadeSize; i++)
+			{
+				T* left = &out.Left[i * out.Stride];
+				T* right = &out.Right[i * out.Stride];
+				*left = (T)(*left * fadeIn + fadeL[i] * fadeOut);
+				*right = (T)(*right * fadeIn + fadeR[i] * fadeOut);
+
+				double c = fadeIn * stepCos + fadeOut * stepSin;
+				fadeOut = fadeOut * stepCos - fadeIn * stepSin;
+				fadeIn = c;
+			}
+
+			fadeRemaining -= fadeSize;
+			if (fadeRemaining == 0)
+			{
+				fadeIn = 1;
+				fadeOut = 0;
+				clearing = true;
+			}
+		}
+	};
+
+	typedef BasicCrossfadeController<float> CrossfadeController;
+}
@@ -0,0 +1,964 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "Utils.h"
+#include "Lp1.h"
+#include "Biquad.h"
+#include "RandomBuffer.h"
+#include "LfoBank.h"
+#include "RingSpan.h"
+#include "SampleStorage.h"
+#include "StateStream.h"
+#include "LcgRandom.h"
+
+#ifndef LATE_LINE_LANES
+#define LATE_LINE_LANES 4
+#endif
+
+namespace Cloudseed
+{
+	// A group of late reverb lines that run in lockstep.
+	// Every line has the same structure: feedback -> modulated delay -> allpass diffuser -> low shelf -> high shelf -> lowpass,
+	// so the state of each stage is stored as a structure of arrays, Lanes values wide, and each stage processes all
+	// lines with a single inner loop over the lanes. Signal buffers are interleaved by lane, sample i of lane l is at [i * Lanes + l].
+	// The inner loops have a fixed trip count, which lets the compiler map them straight onto SIMD registers.
+	// T is the sample type, TStorage the type the delay and diffuser history is stored as, see SampleStorage.
+	template<int Lanes, typename T, typename TStorage = T>
+	class DelayLineBank
+	{
+	public:
+		static const int MaxStageCount = 12;
+
+	private:
+		typedef SampleStorage<T, TStorage> Storage;
+
+		int samplerate;
+
+		// Feedback FIFO, one block of latency, shared read/write position
+		T* feedbackBuffer;
+		int feedbackBufferSize; // in frames of Lanes samples, a power of two
+		int feedbackMask;
+		int feedbackIdxRead;
+		int feedbackIdxWrite;
+		int feedbackCount;
+		T feedback[Lanes];
+
+		// Scratch for one block, maxBlockSize frames of Lanes samples
+		T* tempBuffer;
+
+		// Modulated delay
+		TStorage* delayBuffer;
+		int delayBufferSize; // a power of two
+		int delayMask;
+		int delayWriteIndex;
+		uint64_t delaySamplesProcessed;
+		int delayReadIndexA[Lanes];
+		int delayReadIndexB[Lanes];
+		LfoBank<Lanes> delayLfo;
+		T delayGainA[Lanes];
+		T delayGainB[Lanes];
+		int delaySampleDelay[Lanes];
+		float delayModAmount[Lanes];
+
+		// Allpass diffuser, one set of lanes per stage
+		TStorage* allpassBuffer[MaxStageCount];
+		int allpassBufferSize; // a power of two
+		int allpassMask;
+		int allpassIndex[MaxStageCount];
+		uint64_t allpassSamplesProcessed[MaxStageCount];
+		LfoBank<Lanes> allpassLfo[MaxStageCount];
+		int allpassDelayA[MaxStageCount][Lanes];
+		int allpassDelayB[MaxStageCount][Lanes];
+		T allpassGainA[MaxStageCount][Lanes];
+		T allpassGainB[MaxStageCount][Lanes];
+		int allpassSampleDelay[MaxStageCount][Lanes];
+		float allpassModAmount[MaxStageCount][Lanes];
+		T allpassFeedback;
+		bool allpassInterpolationEnabled;
+		bool allpassModulationEnabled;
+		int diffuserStages;
+		int diffuserDelay;
+		RandomSeries<MaxStageCount * 3> diffuserSeedValues[Lanes];
+		float diffuserModAmount[Lanes]; // before the per-stage spread, which comes from the seed values
+		float diffuserModRate[Lanes];
+
+		// Shelving filters and lowpass. The Biquad and Lp1 instances are only used to design the coefficients
+		Biquad lowShelfDesign;
+		Biquad highShelfDesign;
+		Lp1<T> lowPassDesign;
+		T lowShelfCoeffs[5];
+		T highShelfCoeffs[5];
+		T lowShelfState[4][Lanes];
+		T highShelfState[4][Lanes];
+		T lowPassB0;
+		T lowPassA1;
+		T lowPassOutput[Lanes];
+
+	public:
+		bool DiffuserEnabled;
+		bool LowShelfEnabled;
+		bool HighShelfEnabled;
+		bool CutoffEnabled;
+		bool TapPostDiffuser;
+
+		DelayLineBank() :
+			lowShelfDesign(Biquad::FilterType::LowShelf, 48000),
+			highShelfDesign(Biquad::FilterType::HighShelf, 48000)
+		{
+			feedbackBuffer = nullptr;
+			feedbackBufferSize = 0;
+			feedbackMask = 0;
+			tempBuffer = nullptr;
+			feedbackIdxRead = 0;
+			feedbackIdxWrite = 0;
+			feedbackCount = 0;
+			delayBuffer = nullptr;
+			delayBufferSize = 0;
+			delayMask = 0;
+			delayWriteIndex = 0;
+			delaySamplesProcessed = 0;
+			for (int l = 0; l < Lanes; l++)
+			{
+				feedback[l] = 0;
+				delaySampleDelay[l] = 100;
+				delayModAmount[l] = 0.0;
+			}
+			UpdateDelayModulation();
+
+			allpassFeedback = 0.5;
+			allpassInterpolationEnabled = true;
+			allpassModulationEnabled = true;
+			diffuserStages = 1;
+			diffuserDelay = 100;
+			allpassBufferSize = 0;
+			allpassMask = 0;
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				allpassBuffer[s] = nullptr;
+				allpassIndex[s] = 0;
+				allpassSamplesProcessed[s] = 0;
+				for (int l = 0; l < Lanes; l++)
+				{
+					allpassSampleDelay[s][l] = 100;
+					allpassModAmount[s][l] = 0.0;
+				}
+				UpdateAllpassModulation(s);
+			}
+
+			lowShelfDesign.SetGainDb(-20);
+			lowShelfDesign.Frequency = 20;
+			highShelfDesign.SetGainDb(-20);
+			highShelfDesign.Frequency = 19000;
+			lowPassDesign.SetCutoffHz(1000);
+			UpdateFilters();
+
+			DiffuserEnabled = false;
+			LowShelfEnabled = false;
+			HighShelfEnabled = false;
+			CutoffEnabled = false;
+			TapPostDiffuser = false;
+
+			SetSamplerate(48000);
+			for (int l = 0; l < Lanes; l++)
+			{
+				diffuserModAmount[l] = 0.0;
+				diffuserModRate[l] = 0.0;
+				SetDiffuserSeed(l, 1, CrossSeed());
+			}
+			ClearBuffers();
+		}
+
+		int GetSamplerate()
+		{
+			return samplerate;
+		}
+
+		// Samples of type T needed by SetWorkspace for blocks of up to maxBlockSize samples
+		static int GetWorkspaceSize(int maxBlockSize)
+		{
+			return (RingSpan::Capacity(2 * maxBlockSize) + maxBlockSize) * Lanes;
+		}
+
+		// The buffer is owned by the caller and holds GetWorkspaceSize() samples, for the feedback FIFO and
+		// the scratch of one block. Process must not be called with more than maxBlockSize samples.
+		// With keepFeedback, the feedback still waiting in the current workspace, which must still be valid, is moved over.
+		void SetWorkspace(T* buffer, int maxBlockSize, bool keepFeedback = false)
+		{
+			auto previous = feedbackBuffer;
+			auto previousMask = feedbackMask;
+			auto previousRead = feedbackIdxRead;
+			auto pending = keepFeedback && previous != nullptr ? feedbackCount : 0;
+
+			feedbackBufferSize = RingSpan::Capacity(2 * maxBlockSize);
+			feedbackMask = feedbackBufferSize - 1;
+			feedbackBuffer = buffer;
+			tempBuffer = &buffer[feedbackBufferSize * Lanes];
+			Utils::ZeroBuffer(feedbackBuffer, feedbackBufferSize * Lanes);
+			if (pending > feedbackBufferSize)
+				pending = feedbackBufferSize;
+			for (int i = 0; i < pending; i++)
+				Utils::Copy(&feedbackBuffer[i * Lanes], &previous[((previousRead + i) & previousMask) * Lanes], Lanes);
+			feedbackIdxRead = 0;
+			feedbackIdxWrite = pending & feedbackMask;
+			feedbackCount = pending;
+		}
+
+		// The buffer is owned by the caller and holds size * Lanes values,
+		// size being at least ModulatedDelay::GetBufferSize() for the longest line. Only the largest power of two that fits is used.
+		// resampleRatio carries the history over, see ModulatedDelay::SetBuffer
+		void SetDelayBuffer(TStorage* buffer, int size, double resampleRatio = 0)
+		{
+			auto previous = delayBuffer;
+			auto previousMask = delayMask;
+			auto previousWrite = delayWriteIndex;
+
+			delayBuffer = buffer;
+			delayBufferSize = RingSpan::CapacityWithin(size);
+			delayMask = delayBufferSize - 1;
+			delayWriteIndex = 0;
+			Storage::Clear(delayBuffer, delayBufferSize * Lanes);
+			if (resampleRatio > 0 && previous != nullptr)
+				RingSpan::Resample<Storage>(previous, previousMask, previousWrite, delayBuffer, delayMask, delayWriteIndex, GetDelayLiveLength(), resampleRatio, Lanes);
+			UpdateDelayReadIndex();
+		}
+
+		// The buffer is owned by the caller and holds MaxStageCount * sizePerStage * Lanes values,
+		// sizePerStage being at least ModulatedAllpass::GetBufferSize() for the longest diffuser delay.
+		// Only the largest power of two that fits is used in each stage. resampleRatio carries the history over,
+		// see ModulatedDelay::SetBuffer
+		void SetAllpassBuffer(TStorage* buffer, int sizePerStage, double resampleRatio = 0)
+		{
+			TStorage* previous[MaxStageCount];
+			int previousIndex[MaxStageCount];
+			auto previousMask = allpassMask;
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				previous[s] = allpassBuffer[s];
+				previousIndex[s] = allpassIndex[s];
+			}
+
+			allpassBufferSize = RingSpan::CapacityWithin(sizePerStage);
+			allpassMask = allpassBufferSize - 1;
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				allpassBuffer[s] = &buffer[s * sizePerStage * Lanes];
+				allpassIndex[s] = allpassBufferSize - 1;
+			}
+			ClearDiffuserBuffers();
+
+			for (int s = 0; s < MaxStageCount && resampleRatio > 0 && previous[s] != nullptr; s++)
+				RingSpan::Resample<Storage>(previous[s], previousMask, previousIndex[s], allpassBuffer[s], allpassMask, allpassIndex[s], GetAllpassLiveLength(s), resampleRatio, Lanes);
+			for (int s = 0; s < MaxStageCount; s++)
+				UpdateAllpassReadIndex(s);
+		}
+
+		void SetSamplerate(int samplerate)
+		{
+			this->samplerate = samplerate;
+			lowPassDesign.SetSamplerate(samplerate);
+			lowShelfDesign.SetSamplerate(samplerate);
+			highShelfDesign.SetSamplerate(samplerate);
+			UpdateFilters();
+		}
+
+		void SetDiffuserSeed(int lane, int seed, const CrossSeed& crossSeed)
+		{
+			if (!diffuserSeedValues[lane].Generate(seed, MaxStageCount * 3, crossSeed))
+				return;
+
+			// the mod amounts and rates are spread by the seed values too
+			UpdateDiffuserDelay(lane);
+			SetDiffuserModAmount(lane, diffuserModAmount[lane]);
+			SetDiffuserModRate(lane, diffuserModRate[lane]);
+		}
+
+		void SetDelay(int lane, int delaySamples)
+		{
+			delaySampleDelay[lane] = delaySamples;
+			UpdateDelayReadIndex();
+		}
+
+		void SetFeedback(int lane, float feedb)
+		{
+			feedback[lane] = feedb;
+		}
+
+		void SetLineModAmount(int lane, float amount)
+		{
+			delayModAmount[lane] = amount;
+			UpdateDelayReadIndex();
+		}
+
+		// rate in cycles per sample
+		void SetLineModRate(int lane, float rate)
+		{
+			delayLfo.SetRate(lane, rate);
+		}
+
+		void SetDiffuserDelay(int delaySamples)
+		{
+			diffuserDelay = delaySamples;
+			for (int l = 0; l < Lanes; l++)
+				UpdateDiffuserDelay(l);
+		}
+
+		void SetDiffuserFeedback(float feedb)
+		{
+			allpassFeedback = feedb;
+		}
+
+		void SetDiffuserStages(int stages)
+		{
+			diffuserStages = stages;
+		}
+
+		void SetDiffuserModAmount(int lane, float amount)
+		{
+			diffuserModAmount[lane] = amount;
+			allpassModulationEnabled = amount > 0.0;
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				allpassModAmount[s][lane] = amount * (0.85 + 0.3 * diffuserSeedValues[lane][MaxStageCount + s]);
+				UpdateAllpassReadIndex(s);
+			}
+		}
+
+		void SetDiffuserModRate(int lane, float rate)
+		{
+			diffuserModRate[lane] = rate;
+			for (int s = 0; s < MaxStageCount; s++)
+				allpassLfo[s].SetRate(lane, rate * (0.85 + 0.3 * diffuserSeedValues[lane][MaxStageCount * 2 + s]) / samplerate);
+		}
+
+		// Number of samples between updates of the modulated delay times
+		void SetModulationUpdateRate(int samples)
+		{
+			delayLfo.SetStepSize(samples);
+			for (int s = 0; s < MaxStageCount; s++)
+				allpassLfo[s].SetStepSize(samples);
+		}
+
+		// Draws the starting phases of the modulation from random, in the same order as a row of individual lines
+		// would draw them: the line delay first, then each of its diffuser stages
+		void RandomizeModPhases(LcgRandom& random)
+		{
+			for (int l = 0; l < Lanes; l++)
+			{
+				delayLfo.SetPhase(l, 0.01 + 0.98 * random.NextFloat());
+				for (int s = 0; s < MaxStageCount; s++)
+					allpassLfo[s].SetPhase(l, 0.01 + 0.98 * random.NextFloat());
+			}
+
+			UpdateDelayReadIndex();
+			for (int s = 0; s < MaxStageCount; s++)
+				UpdateAllpassReadIndex(s);
+		}
+
+		void SetInterpolationEnabled(bool value)
+		{
+			allpassInterpolationEnabled = value;
+		}
+
+		void SetLowShelfGain(float gainDb)
+		{
+			lowShelfDesign.SetGainDb(gainDb);
+			lowShelfDesign.Update();
+			UpdateFilters();
+		}
+
+		void SetLowShelfFrequency(float frequency)
+		{
+			lowShelfDesign.Frequency = ClampFrequency(frequency);
+			lowShelfDesign.Update();
+			UpdateFilters();
+		}
+
+		void SetHighShelfGain(float gainDb)
+		{
+			highShelfDesign.SetGainDb(gainDb);
+			highShelfDesign.Update();
+			UpdateFilters();
+		}
+
+		void SetHighShelfFrequency(float frequency)
+		{
+			highShelfDesign.Frequency = ClampFrequency(frequency);
+			highShelfDesign.Update();
+			UpdateFilters();
+		}
+
+		void SetCutoffFrequency(float frequency)
+		{
+			lowPassDesign.SetCutoffHz(frequency);
+			UpdateFilters();
+		}
+
+		// Processes every lane and adds the output of the first activeLanes lanes into lineSum
+		void Process(const T* input, T* lineSum, int bufSize, int activeLanes)
+		{
+			PopFeedback(tempBuffer, bufSize);
+			for (int i = 0; i < bufSize; i++)
+			{
+				T* t = &tempBuffer[i * Lanes];
+				for (int l = 0; l < Lanes; l++)
+					t[l] = input[i] + t[l] * feedback[l];
+			}
+
+			ProcessDelay(tempBuffer, bufSize);
+
+			if (!TapPostDiffuser)
+				MixLanes(tempBuffer, lineSum, bufSize, activeLanes);
+			if (DiffuserEnabled)
+			{
+				for (int s = 0; s < diffuserStages; s++)
+				{
+					if (allpassModulationEnabled)
+						ProcessAllpassWithMod(s, tempBuffer, bufSize);
+					else
+						ProcessAllpassNoMod(s, tempBuffer, bufSize);
+				}
+			}
+			if (LowShelfEnabled)
+				ProcessBiquad(lowShelfCoeffs, lowShelfState, tempBuffer, bufSize);
+			if (HighShelfEnabled)
+				ProcessBiquad(highShelfCoeffs, highShelfState, tempBuffer, bufSize);
+			if (CutoffEnabled)
+				ProcessLowPass(tempBuffer, bufSize);
+
+			PushFeedback(tempBuffer, bufSize);
+
+			if (TapPostDiffuser)
+				MixLanes(tempBuffer, lineSum, bufSize, activeLanes);
+		}
+
+		// Largest magnitude waiting in the feedback path, i.e. what the lines will feed back into themselves next
+		T GetFeedbackPeak(int activeLanes)
+		{
+			T peak = 0;
+			int idx = feedbackIdxRead;
+			for (int i = 0; i < feedbackCount; i++)
+			{
+				T* f = &feedbackBuffer[idx * Lanes];
+				for (int l = 0; l < activeLanes; l++)
+				{
+					T val = f[l] < 0 ? -f[l] : f[l];
+					if (val > peak)
+						peak = val;
+				}
+				idx = (idx + 1) & feedbackMask;
+			}
+			return peak;
+		}
+
+		// Takes over every setting of another bank: delays, gains, modulation, seed tables and filter coefficients.
+		// This bank's buffers, write positions, LFO phases and filter states are kept. Costs a copy of the tables instead of
+		// regenerating seeds and redesigning filters.
+		void CopySettings(const DelayLineBank& source)
+		{
+			samplerate = source.samplerate;
+			for (int l = 0; l < Lanes; l++)
+			{
+				feedback[l] = source.feedback[l];
+				delaySampleDelay[l] = source.delaySampleDelay[l];
+				delayModAmount[l] = source.delayModAmount[l];
+				diffuserSeedValues[l] = source.diffuserSeedValues[l];
+				diffuserModAmount[l] = source.diffuserModAmount[l];
+				diffuserModRate[l] = source.diffuserModRate[l];
+			}
+			delayLfo.CopyRates(source.delayLfo);
+
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				for (int l = 0; l < Lanes; l++)
+				{
+					allpassSampleDelay[s][l] = source.allpassSampleDelay[s][l];
+					allpassModAmount[s][l] = source.allpassModAmount[s][l];
+				}
+				allpassLfo[s].CopyRates(source.allpassLfo[s]);
+			}
+			allpassFeedback = source.allpassFeedback;
+			allpassInterpolationEnabled = source.allpassInterpolationEnabled;
+			allpassModulationEnabled = source.allpassModulationEnabled;
+			diffuserStages = source.diffuserStages;
+			diffuserDelay = source.diffuserDelay;
+
+			lowShelfDesign = source.lowShelfDesign;
+			highShelfDesign = source.highShelfDesign;
+			lowPassDesign.CopySettings(source.lowPassDesign);
+			for (int k = 0; k < 5; k++)
+			{
+				lowShelfCoeffs[k] = source.lowShelfCoeffs[k];
+				highShelfCoeffs[k] = source.highShelfCoeffs[k];
+			}
+			lowPassB0 = source.lowPassB0;
+			lowPassA1 = source.lowPassA1;
+
+			DiffuserEnabled = source.DiffuserEnabled;
+			LowShelfEnabled = source.LowShelfEnabled;
+			HighShelfEnabled = source.HighShelfEnabled;
+			CutoffEnabled = source.CutoffEnabled;
+			TapPostDiffuser = source.TapPostDiffuser;
+
+			UpdateDelayReadIndex();
+			for (int s = 0; s < MaxStageCount; s++)
+				UpdateAllpassReadIndex(s);
+		}
+
+		// Frames of history the delay lines can still read at their current settings, anything older is never read again
+		int GetDelayLiveLength()
+		{
+			int length = 0;
+			for (int l = 0; l < Lanes; l++)
+				length = std::max(length, delaySampleDelay[l] + (int)std::ceil(delayModAmount[l]) + 2); // see ModulatedDelay::GetLiveLength
+			return length < delayBufferSize ? length : delayBufferSize;
+		}
+
+		// Same for one diffuser stage. A lane without a delay reads the whole buffer
+		int GetAllpassLiveLength(int stage)
+		{
+			int length = 0;
+			for (int l = 0; l < Lanes; l++)
+				length = allpassSampleDelay[stage][l] > 0
+					? std::max(length, allpassSampleDelay[stage][l] + (int)std::ceil(allpassModAmount[stage][l]) + 2)
+					: allpassBufferSize;
+			return length < allpassBufferSize ? length : allpassBufferSize;
+		}
+
+		void ClearDiffuserBuffers()
+		{
+			for (int s = 0; s < MaxStageCount; s++)
+				Storage::Clear(allpassBuffer[s], allpassBufferSize * Lanes);
+		}
+
+		// Only the shelf and lowpass states, the delay memory is left as it is
+		void ClearFilterState()
+		{
+			Utils::ZeroBuffer(&lowShelfState[0][0], 4 * Lanes);
+			Utils::ZeroBuffer(&highShelfState[0][0], 4 * Lanes);
+			Utils::ZeroBuffer(lowPassOutput, Lanes);
+		}
+
+		void ClearBuffers()
+		{
+			Storage::Clear(delayBuffer, delayBufferSize * Lanes);
+			ClearDiffuserBuffers();
+			Utils::ZeroBuffer(feedbackBuffer, feedbackBufferSize * Lanes);
+			ClearState();
+		}
+
+		// Everything ClearBuffers resets apart from the memory: the filter states and the pending feedback
+		void ClearState()
+		{
+			ClearFilterState();
+			feedbackIdxRead = 0;
+			feedbackIdxWrite = 0;
+			feedbackCount = 0;
+		}
+
+		// The pending feedback, the live part of the delay and diffuser history, the read positions, LFOs and filter
+		// states. Every diffuser stage is included, the unused ones keep their history for when they are switched back on.
+		// The delays and modulation amounts are included as well, see ModulatedDelay::SaveState.
+		void SaveState(StateWriter& writer)
+		{
+			writer.WriteRing(feedbackBuffer, feedbackMask, feedbackIdxWrite, feedbackCount, Lanes);
+
+			// read positions are stored as distances from the write position
+			int distanceA[Lanes];
+			int distanceB[Lanes];
+			for (int l = 0; l < Lanes; l++)
+			{
+				distanceA[l] = (delayWriteIndex - delayReadIndexA[l]) & delayMask;
+				distanceB[l] = (delayWriteIndex - delayReadIndexB[l]) & delayMask;
+			}
+			writer.WriteRing(delayBuffer, delayMask, delayWriteIndex, GetDelayLiveLength(), Lanes);
+			writer.Write(distanceA, Lanes);
+			writer.Write(distanceB, Lanes);
+			writer.Write(delayGainA, Lanes);
+			writer.Write(delayGainB, Lanes);
+			writer.Write(delaySamplesProcessed);
+			delayLfo.SaveState(writer);
+			writer.Write(delaySampleDelay, Lanes);
+			writer.Write(delayModAmount, Lanes);
+
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				writer.WriteRing(allpassBuffer[s], allpassMask, allpassIndex[s], GetAllpassLiveLength(s), Lanes);
+				writer.Write(allpassDelayA[s], Lanes);
+				writer.Write(allpassDelayB[s], Lanes);
+				writer.Write(allpassGainA[s], Lanes);
+				writer.Write(allpassGainB[s], Lanes);
+				writer.Write(allpassSamplesProcessed[s]);
+				allpassLfo[s].SaveState(writer);
+				writer.Write(allpassSampleDelay[s], Lanes);
+				writer.Write(allpassModAmount[s], Lanes);
+			}
+
+			writer.Write(&lowShelfState[0][0], 4 * Lanes);
+			writer.Write(&highShelfState[0][0], 4 * Lanes);
+			writer.Write(lowPassOutput, Lanes);
+		}
+
+		// Restores what SaveState wrote into a cleared bank
+		void LoadState(StateReader& reader)
+		{
+			int pending = reader.ReadRing(feedbackBuffer, feedbackMask, feedbackIdxWrite, Lanes);
+			feedbackIdxRead = (feedbackIdxWrite - pending) & feedbackMask;
+			feedbackCount = pending;
+
+			int distanceA[Lanes];
+			int distanceB[Lanes];
+			reader.ReadRing(delayBuffer, delayMask, delayWriteIndex, Lanes);
+			reader.Read(distanceA, Lanes);
+			reader.Read(distanceB, Lanes);
+			for (int l = 0; l < Lanes; l++)
+			{
+				if (distanceA[l] < 0 || distanceA[l] >= delayBufferSize || distanceB[l] < 0 || distanceB[l] >= delayBufferSize)
+					reader.Fail();
+				delayReadIndexA[l] = (delayWriteIndex - distanceA[l]) & delayMask;
+				delayReadIndexB[l] = (delayWriteIndex - distanceB[l]) & delayMask;
+			}
+			reader.Read(delayGainA, Lanes);
+			reader.Read(delayGainB, Lanes);
+			delaySamplesProcessed = reader.Read<uint64_t>();
+			delayLfo.LoadState(reader);
+			reader.Read(delaySampleDelay, Lanes);
+			reader.Read(delayModAmount, Lanes);
+
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				reader.ReadRing(allpassBuffer[s], allpassMask, allpassIndex[s], Lanes);
+				reader.Read(allpassDelayA[s], Lanes);
+				reader.Read(allpassDelayB[s], Lanes);
+				for (int l = 0; l < Lanes; l++)
+					if (allpassDelayA[s][l] < 0 || allpassDelayB[s][l] < 0 || allpassDelayB[s][l] >= allpassBufferSize)
+						reader.Fail();
+				reader.Read(allpassGainA[s], Lanes);
+				reader.Read(allpassGainB[s], Lanes);
+				allpassSamplesProcessed[s] = reader.Read<uint64_t>();
+				allpassLfo[s].LoadState(reader);
+				reader.Read(allpassSampleDelay[s], Lanes);
+				reader.Read(allpassModAmount[s], Lanes);
+			}
+
+			reader.Read(&lowShelfState[0][0], 4 * Lanes);
+			reader.Read(&highShelfState[0][0], 4 * Lanes);
+			reader.Read(lowPassOutput, Lanes);
+		}
+
+	private:
+		// The FIFO is a power of two ring of frames, so a block moves in at most two contiguous copies
+		void PopFeedback(T* dest, int bufSize)
+		{
+			int count = feedbackCount < bufSize ? feedbackCount : bufSize;
+			RingSpan::ForEach(feedbackIdxRead, count, feedbackMask, [&](int pos, int offset, int len)
+			{
+				Utils::Copy(&dest[offset * Lanes], &feedbackBuffer[pos * Lanes], len * Lanes);
+			});
+
+			if (count < bufSize)
+				Utils::ZeroBuffer(&dest[count * Lanes], (bufSize - count) * Lanes);
+
+			feedbackIdxRead = (feedbackIdxRead + count) & feedbackMask;
+			feedbackCount -= count;
+		}
+
+		void PushFeedback(T* data, int bufSize)
+		{
+			int room = feedbackBufferSize - feedbackCount;
+			int count = bufSize < room ? bufSize : room; // overflow drops the rest
+			RingSpan::ForEach(feedbackIdxWrite, count, feedbackMask, [&](int pos, int offset, int len)
+			{
+				Utils::Copy(&feedbackBuffer[pos * Lanes], &data[offset * Lanes], len * Lanes);
+			});
+
+			feedbackIdxWrite = (feedbackIdxWrite + count) & feedbackMask;
+			feedbackCount += count;
+		}
+
+		void MixLanes(T* data, T* lineSum, int bufSize, int activeLanes)
+		{
+			for (int i = 0; i < bufSize; i++)
+			{
+				T* d = &data[i * Lanes];
+				for (int l = 0; l < activeLanes; l++)
+					lineSum[i] += d[l];
+			}
+		}
+
+		void ProcessDelay(T* data, int bufSize)
+		{
+			for (int i = 0; i < bufSize; i++)
+			{
+				if (delaySamplesProcessed >= (uint64_t)delayLfo.GetStepSize())
+				{
+					UpdateDelayModulation();
+					delaySamplesProcessed = 0;
+				}
+
+				T* d = &data[i * Lanes];
+				Storage::Store(&delayBuffer[delayWriteIndex * Lanes], d, Lanes);
+
+				for (int l = 0; l < Lanes; l++)
+				{
+					d[l] = Storage::Decode(delayBuffer[delayReadIndexA[l] * Lanes + l]) * delayGainA[l]
+						+ Storage::Decode(delayBuffer[delayReadIndexB[l] * Lanes + l]) * delayGainB[l];
+
+					delayReadIndexA[l] = (delayReadIndexA[l] + 1) & delayMask;
+					delayReadIndexB[l] = (delayReadIndexB[l] + 1) & delayMask;
+				}
+
+				delayWriteIndex = (delayWriteIndex + 1) & delayMask;
+				delaySamplesProcessed++;
+			}
+		}
+
+		void ProcessAllpassNoMod(int stage, T* data, int bufSize)
+		{
+			TStorage* buffer = allpassBuffer[stage];
+			int index = allpassIndex[stage];
+			int delayedIndex[Lanes];
+			T fb = allpassFeedback;
+
+			for (int l = 0; l < Lanes; l++)
+			{
+				auto sampleDelay = allpassSampleDelay[stage][l] < allpassBufferSize ? allpassSampleDelay[stage][l] : allpassBufferSize - 1;
+				delayedIndex[l] = (index - sampleDelay) & allpassMask;
+			}
+
+			for (int i = 0; i < bufSize; i++)
+			{
+				T* d = &data[i * Lanes];
+				TStorage* w = &buffer[index * Lanes];
+				for (int l = 0; l < Lanes; l++)
+				{
+					T bufOut = Storage::Decode(buffer[delayedIndex[l] * Lanes + l]);
+					T inVal = d[l] + bufOut * fb;
+					w[l] = Storage::Encode(inVal);
+					d[l] = bufOut - inVal * fb;
+					delayedIndex[l] = (delayedIndex[l] + 1) & allpassMask;
+				}
+
+				index = (index + 1) & allpassMask;
+			}
+
+			allpassIndex[stage] = index;
+			allpassSamplesProcessed[stage] += bufSize;
+		}
+
+		void ProcessAllpassWithMod(int stage, T* data, int bufSize)
+		{
+			TStorage* buffer = allpassBuffer[stage];
+			int* delayA = allpassDelayA[stage];
+			int* delayB = allpassDelayB[stage];
+			T* gainA = allpassGainA[stage];
+			T* gainB = allpassGainB[stage];
+			int index = allpassIndex[stage];
+			T fb = allpassFeedback;
+
+			for (int i = 0; i < bufSize; i++)
+			{
+				if (allpassSamplesProcessed[stage] >= (uint64_t)allpassLfo[stage].GetStepSize())
+				{
+					UpdateAllpassModulation(stage);
+					allpassSamplesProcessed[stage] = 0;
+				}
+
+				T* d = &data[i * Lanes];
+				T bufOut[Lanes];
+
+				if (allpassInterpolationEnabled)
+				{
+					for (int l = 0; l < Lanes; l++)
+					{
+						int idxA = (index - delayA[l]) & allpassMask;
+						int idxB = (index - delayB[l]) & allpassMask;
+						bufOut[l] = Storage::Decode(buffer[idxA * Lanes + l]) * gainA[l] + Storage::Decode(buffer[idxB * Lanes + l]) * gainB[l];
+					}
+				}
+				else
+				{
+					for (int l = 0; l < Lanes; l++)
+					{
+						int idxA = (index - delayA[l]) & allpassMask;
+						bufOut[l] = Storage::Decode(buffer[idxA * Lanes + l]);
+					}
+				}
+
+				TStorage* w = &buffer[index * Lanes];
+				for (int l = 0; l < Lanes; l++)
+				{
+					T inVal = d[l] + bufOut[l] * fb;
+					w[l] = Storage::Encode(inVal);
+					d[l] = bufOut[l] - inVal * fb;
+				}
+
+				index = (index + 1) & allpassMask;
+				allpassSamplesProcessed[stage]++;
+			}
+
+			allpassIndex[stage] = index;
+		}
+
+		void ProcessBiquad(T* coeffs, T state[4][Lanes], T* data, int bufSize)
+		{
+			T b0 = coeffs[0];
+			T b1 = coeffs[1];
+			T b2 = coeffs[2];
+			T a1 = coeffs[3];
+			T a2 = coeffs[4];
+			T* x1 = state[0];
+			T* x2 = state[1];
+			T* y1 = state[2];
+			T* y2 = state[3];
+
+			for (int i = 0; i < bufSize; i++)
+			{
+				T* d = &data[i * Lanes];
+				for (int l = 0; l < Lanes; l++)
+				{
+					T x = d[l];
+					T y = ((b0 * x) + (b1 * x1[l]) + (b2 * x2[l])) - (a1 * y1[l]) - (a2 * y2[l]);
+					x2[l] = x1[l];
+					y2[l] = y1[l];
+					x1[l] = x;
+					y1[l] = y;
+					d[l] = y;
+				}
+			}
+		}
+
+		void ProcessLowPass(T* data, int bufSize)
+		{
+			for (int i = 0; i < bufSize; i++)
+			{
+				T* d = &data[i * Lanes];
+				for (int l = 0; l < Lanes; l++)
+				{
+					T input = d[l];
+					T y = lowPassB0 * input + lowPassA1 * lowPassOutput[l];
+					lowPassOutput[l] = (input == 0 && lowPassOutput[l] < 0.0000001f) ? 0.0f : y;
+					d[l] = lowPassOutput[l];
+				}
+			}
+		}
+
+		// Keeps the shelves below Nyquist when the lines run at a reduced samplerate
+		float ClampFrequency(float frequency)
+		{
+			float maxFrequency = 0.49f * samplerate;
+			return frequency < maxFrequency ? frequency : maxFrequency;
+		}
+
+		void UpdateFilters()
+		{
+			float c[5];
+			lowShelfDesign.GetCoefficients(c[0], c[1], c[2], c[3], c[4]);
+			for (int k = 0; k < 5; k++)
+				lowShelfCoeffs[k] = c[k];
+			highShelfDesign.GetCoefficients(c[0], c[1], c[2], c[3], c[4]);
+			for (int k = 0; k < 5; k++)
+				highShelfCoeffs[k] = c[k];
+			lowPassB0 = lowPassDesign.GetB0();
+			lowPassA1 = lowPassDesign.GetA1();
+		}
+
+		void UpdateDiffuserDelay(int lane)
+		{
+			for (int s = 0; s < MaxStageCount; s++)
+			{
+				auto r = diffuserSeedValues[lane][s];
+				auto d = std::pow(10, r) * 0.1; // 0.1 ... 1.0
+				allpassSampleDelay[s][lane] = (int)(diffuserDelay * d);
+				UpdateAllpassReadIndex(s);
+			}
+		}
+
+		void UpdateDelayModulation()
+		{
+			delayLfo.Advance();
+			UpdateDelayReadIndex();
+		}
+
+		void UpdateDelayReadIndex()
+		{
+			for (int l = 0; l < Lanes; l++)
+			{
+				auto mod = delayLfo.GetSin(l);
+				auto totalDelay = delaySampleDelay[l] + delayModAmount[l] * mod;
+				if (delayBufferSize > 0 && totalDelay > delayBufferSize - 2) // out of range settings, stay inside the buffer
+					totalDelay = delayBufferSize - 2;
+
+				auto delayA = (int)totalDelay;
+				auto delayB = (int)totalDelay + 1;
+
+				auto partial = totalDelay - delayA;
+
+				delayGainA[l] = 1 - partial;
+				delayGainB[l] = partial;
+
+				delayReadIndexA[l] = (delayWriteIndex - delayA) & delayMask;
+				delayReadIndexB[l] = (delayWriteIndex - delayB) & delayMask;
+			}
+		}
+
+		void UpdateAllpassModulation(int stage)
+		{
+			allpassLfo[stage].Advance();
+			UpdateAllpassReadIndex(stage);
+		}
+
+		void UpdateAllpassReadIndex(int stage)
+		{
+			auto& lfo = allpassLfo[stage];
+			for (int l = 0; l < Lanes; l++)
+			{
+				auto modAmount = allpassModAmount[stage][l];
+				auto sampleDelay = allpassSampleDelay[stage][l];
+				auto mod = lfo.GetSin(l);
+
+				if (modAmount >= sampleDelay) // don't modulate to negative value
+					modAmount = sampleDelay - 1;
+
+				auto totalDelay = sampleDelay + modAmount * mod;
+
+				if (totalDelay <= 0) // should no longer be required
+					totalDelay = 1;
+				if (allpassBufferSize > 0 && totalDelay > allpassBufferSize - 2) // out of range settings, stay inside the buffer
+					totalDelay = allpassBufferSize - 2;
+
+				allpassDelayA[stage][l] = (int)totalDelay;
+				allpassDelayB[stage][l] = (int)totalDelay + 1;
+
+				auto partial = totalDelay - allpassDelayA[stage][l];
+
+				allpassGainA[stage][l] = 1 - partial;
+				allpassGainB[stage][l] = partial;
+			}
+		}
+	};
+}
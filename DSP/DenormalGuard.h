@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#define CLOUDSEED_DENORMALS_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CLOUDSEED_DENORMALS_ARM64
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace Cloudseed
+{
+	// Switches the calling thread's floating point unit to flush denormals to zero for the lifetime of the guard,
+	// and restores the previous mode when it goes out of scope.
+	// Decaying feedback loops otherwise end up computing on denormal numbers, which are many times slower
+	// than normal ones on most CPUs. On x86 this sets FTZ and DAZ in MXCSR, on ARM64 the FZ bit of FPCR.
+	// Does nothing on other platforms.
+	class DenormalGuard
+	{
+	private:
+		uint64_t previous;
+		bool active;
+
+	public:
+		DenormalGuard(bool enabled = true)
+		{
+			previous = 0;
+			active = enabled;
+			if (!active)
+				return;
+
+#if defined(CLOUDSEED_DENORMALS_X86)
+			previous = _mm_getcsr();
+			_mm_setcsr((unsigned int)previous | 0x8040); // FTZ (bit 15) | DAZ (bit 6)
+#elif defined(CLOUDSEED_DENORMALS_ARM64) && defined(_MSC_VER)
+			previous = _ReadStatusReg(ARM64_FPCR);
+			_WriteStatusReg(ARM64_FPCR, previous | (1 << 24));
+#elif defined(CLOUDSEED_DENORMALS_ARM64)
+			asm volatile("mrs %0, fpcr" : "=r"(previous));
+			asm volatile("msr fpcr, %0" : : "r"(previous | (1 << 24)));
+#endif
+		}
+
+		~DenormalGuard()
+		{
+			if (!active)
+				return;
+
+#if defined(CLOUDSEED_DENORMALS_X86)
+			_mm_setcsr((unsigned int)previous);
+#elif defined(CLOUDSEED_DENORMALS_ARM64) && defined(_MSC_VER)
+			_WriteStatusReg(ARM64_FPCR, previous);
+#elif defined(CLOUDSEED_DENORMALS_ARM64)
+			asm volatile("msr fpcr, %0" : : "r"(previous));
+#endif
+		}
+
+		DenormalGuard(const DenormalGuard&) = delete;
+		DenormalGuard& operator=(const DenormalGuard&) = delete;
+	};
+}
@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include "Utils.h"
+
+namespace Cloudseed
+{
+	// Real input FFT of a power of two size, computed as a complex FFT of half the size.
+	// Spectra are stored as separate real and imaginary arrays of Size / 2 + 1 bins.
+	template<typename T>
+	class Fft
+	{
+	private:
+		int size;
+		int half;
+		std::vector<int> bitReverse;
+		std::vector<T> cosTable; // twiddles of the half size complex FFT
+		std::vector<T> sinTable;
+		std::vector<T> splitCos; // twiddles that split the packed result into the real spectrum
+		std::vector<T> splitSin;
+		std::vector<T> workRe;
+		std::vector<T> workIm;
+
+	public:
+		Fft(int size = 4)
+		{
+			SetSize(size);
+		}
+
+		// size must be a power of two, 4 or larger. Allocates, so call this from a non-realtime thread.
+		void SetSize(int size)
+		{
+			this->size = size;
+			half = size / 2;
+
+			int bits = 0;
+			while ((1 << bits) < half)
+				bits++;
+
+			bitReverse.resize(half);
+			for (int i = 0; i < half; i++)
+			{
+				int r = 0;
+				for (int b = 0; b < bits; b++)
+					r |= ((i >> b) & 1) << (bits - 1 - b);
+				bitReverse[i] = r;
+			}
+
+			cosTable.resize(half / 2);
+			sinTable.resize(half / 2);
+			for (int i = 0; i < half / 2; i++)
+			{
+				cosTable[i] = (T)std::cos(2 * M_PI * i / half);
+				sinTable[i] = (T)std::sin(2 * M_PI * i / half);
+			}
+
+			splitCos.resize(half + 1);
+			splitSin.resize(half + 1);
+			for (int k = 0; k <= half; k++)
+			{
+				splitCos[k] = (T)std::cos(2 * M_PI * k / size);
+				splitSin[k] = (T)std::sin(2 * M_PI * k / size);
+			}
+
+			workRe.resize(half);
+			workIm.resize(half);
+		}
+
+		int GetSize()
+		{
+			return size;
+		}
+
+		// Bins 0 ... Size / 2 of the spectrum of size real samples
+		void Forward(const T* input, T* re, T* im)
+		{
+			for (int n = 0; n < half; n++)
+			{
+				workRe[bitReverse[n]] = input[2 * n];
+				workIm[bitReverse[n]] = input[2 * n + 1];
+			}
+
+			Transform(workRe.data(), workIm.data(), false);
+
+			for (int k = 0; k <= half; k++)
+			{
+				int a = k == half ? 0 : k;
+				int b = k == 0 ? 0 : half - k;
+				// even and odd half spectra, recovered from the packed transform
+				T evenRe = 0.5f * (workRe[a] + workRe[b]);
+				T evenIm = 0.5f * (workIm[a] - workIm[b]);
+				T oddRe = 0.5f * (workIm[a] + workIm[b]);
+				T oddIm = -0.5f * (workRe[a] - workRe[b]);
+				// X[k] = E[k] + e^(-2 pi i k / size) O[k]
+				T c = splitCos[k];
+				T s = splitSin[k];
+				re[k] = evenRe + c * oddRe + s * oddIm;
+				im[k] = evenIm + c * oddIm - s * oddRe;
+			}
+		}
+
+		// size real samples from bins 0 ... Size / 2, scaled so that Inverse(Forward(x)) == x
+		void Inverse(const T* re, const T* im, T* output)
+		{
+			for (int k = 0; k < half; k++)
+			{
+				int b = half - k;
+				T evenRe = 0.5f * (re[k] + re[b]);
+				T evenIm = 0.5f * (im[k] - im[b]);
+				T diffRe = 0.5f * (re[k] - re[b]);
+				T diffIm = 0.5f * (im[k] + im[b]);
+				// O[k] = (X[k] - conj(X[half - k])) / 2 * e^(2 pi i k / size)
+				T c = splitCos[k];
+				T s = splitSin[k];
+				T oddRe = diffRe * c - diffIm * s;
+				T oddIm = diffRe * s + diffIm * c;
+				// Z[k] = E[k] + i O[k]
+				int r = bitReverse[k];
+				workRe[r] = evenRe - oddIm;
+				workIm[r] = evenIm + oddRe;
+			}
+
+			Transform(workRe.data(), workIm.data(), true);
+
+			T scale = (T)1 / half;
+			for (int n = 0; n < half; n++)
+			{
+				output[2 * n] = workRe[n] * scale;
+				output[2 * n + 1] = workIm[n] * scale;
+			}
+		}
+
+	private:
+		// In place radix-2 transform of half points, input already in bit reversed order
+		void Transform(T* re, T* im, bool inverse)
+		{
+			T sign = inverse ? 1 : -1;
+			for (int len = 2; len <= half; len <<= 1)
+			{
+				int step = half / len;
+				int halfLen = len / 2;
+				for (int start = 0; start < half; start += len)
+				{
+					for (int j = 0; j < halfLen; j++)
+					{
+						T c = cosTable[j * step];
+						T s = sinTable[j * step] * sign;
+
+						int a = start + j;
+						int b = a + halfLen;
+						T xr = re[b] * c - im[b] * s;
+						T xi = re[b] * s + im[b] * c;
+						re[b] = re[a] - xr;
+						im[b] = im[a] - xi;
+						re[a] += xr;
+						im[a] += xi;
+					}
+				}
+			}
+		}
+	};
+}
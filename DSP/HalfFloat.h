@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#define CLOUDSEED_F16C
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+#define CLOUDSEED_FP16_ARM64
+#endif
+
+namespace Cloudseed
+{
+	// IEEE 754 half precision, 1 sign, 5 exponent and 10 mantissa bits. Holds +-65504 with 11 bits of precision,
+	// about -66dB of rounding noise relative to the signal. Converts with F16C on x86 when the compiler targets it
+	// (-mf16c or /arch:AVX2), natively on ARM64, and with a portable bit conversion otherwise.
+	struct Half
+	{
+		uint16_t Bits;
+
+		static inline Half FromFloat(float value)
+		{
+			Half h;
+#if defined(CLOUDSEED_F16C)
+			h.Bits = (uint16_t)_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#elif defined(CLOUDSEED_FP16_ARM64)
+			__fp16 f = (__fp16)value;
+			memcpy(&h.Bits, &f, 2);
+#else
+			h.Bits = EncodeBits(value);
+#endif
+			return h;
+		}
+
+		inline float ToFloat() const
+		{
+#if defined(CLOUDSEED_F16C)
+			return _cvtsh_ss(Bits);
+#elif defined(CLOUDSEED_FP16_ARM64)
+			__fp16 f;
+			memcpy(&f, &Bits, 2);
+			return (float)f;
+#else
+			return DecodeBits(Bits);
+#endif
+		}
+
+		static inline void FromFloat(Half* dest, const float* source, int len)
+		{
+			int i = 0;
+#if defined(CLOUDSEED_F16C)
+			for (; i + 8 <= len; i += 8)
+				_mm_storeu_si128((__m128i*)&dest[i], _mm256_cvtps_ph(_mm256_loadu_ps(&source[i]), _MM_FROUND_TO_NEAREST_INT));
+			for (; i + 4 <= len; i += 4)
+				_mm_storel_epi64((__m128i*)&dest[i], _mm_cvtps_ph(_mm_loadu_ps(&source[i]), _MM_FROUND_TO_NEAREST_INT));
+#endif
+			for (; i < len; i++)
+				dest[i] = FromFloat(source[i]);
+		}
+
+		static inline void ToFloat(float* dest, const Half* source, int len)
+		{
+			int i = 0;
+#if defined(CLOUDSEED_F16C)
+			for (; i + 8 <= len; i += 8)
+				_mm256_storeu_ps(&dest[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&source[i])));
+			for (; i + 4 <= len; i += 4)
+				_mm_storeu_ps(&dest[i], _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)&source[i])));
+#endif
+			for (; i < len; i++)
+				dest[i] = source[i].ToFloat();
+		}
+
+		// Round to nearest even, overflow goes to infinity, small values become half precision subnormals
+		static inline uint16_t EncodeBits(float value)
+		{
+			uint32_t x;
+			memcpy(&x, &value, 4);
+			uint32_t sign = (x >> 16) & 0x8000;
+			x &= 0x7FFFFFFF;
+
+			if (x >= 0x7F800000) // infinity or NaN
+				return (uint16_t)(sign | (x > 0x7F800000 ? 0x7E00 : 0x7C00));
+			if (x >= 0x477FF000) // rounds beyond 65504
+				return (uint16_t)(sign | 0x7C00);
+			if (x <= 0x33000000) // at most half the smallest subnormal, 2^-25
+				return (uint16_t)sign;
+
+			uint32_t h;
+			uint32_t remainder;
+			uint32_t halfway;
+			if (x < 0x38800000) // below 2^-14, a subnormal in units of 2^-24
+			{
+				uint32_t mantissa = (x & 0x7FFFFF) | 0x800000;
+				int shift = 126 - (int)(x >> 23);
+				h = mantissa >> shift;
+				remainder = mantissa & ((1u << shift) - 1);
+				halfway = 1u << (shift - 1);
+			}
+			else
+			{
+				h = (x - 0x38000000) >> 13; // rebias the exponent from 127 to 15
+				remainder = x & 0x1FFF;
+				halfway = 0x1000;
+			}
+
+			if (remainder > halfway || (remainder == halfway && (h & 1)))
+				h++; // a carry out of the mantissa correctly bumps the exponent
+			return (uint16_t)(sign | h);
+		}
+
+		static inline float DecodeBits(uint16_t bits)
+		{
+			uint32_t sign = (uint32_t)(bits & 0x8000) << 16;
+			uint32_t exponent = (bits >> 10) & 0x1F;
+			uint32_t mantissa = bits & 0x3FF;
+
+			if (exponent == 0) // zero or subnormal
+			{
+				float value = mantissa * (1.0f / 16777216.0f);
+				return sign ? -value : value;
+			}
+
+			uint32_t x = exponent == 31
+				? sign | 0x7F800000 | (mantissa << 13)
+				: sign | ((exponent + 112) << 23) | (mantissa << 13);
+			float value;
+			memcpy(&value, &x, 4);
+			return value;
+		}
+	};
+
+	// The upper 16 bits of a float, 8 exponent and 7 mantissa bits. Same range as float, but only 8 bits of
+	// precision, about -48dB of rounding noise. Converting is a shift and a rounding add, which vectorises anywhere.
+	struct BFloat16
+	{
+		uint16_t Bits;
+
+		// Round to nearest even. NaN payloads held only in the low bits round to infinity, which the reverb never stores.
+		static inline BFloat16 FromFloat(float value)
+		{
+			uint32_t x;
+			memcpy(&x, &value, 4);
+			x += 0x7FFF + ((x >> 16) & 1);
+			BFloat16 b;
+			b.Bits = (uint16_t)(x >> 16);
+			return b;
+		}
+
+		inline float ToFloat() const
+		{
+			uint32_t x = (uint32_t)Bits << 16;
+			float value;
+			memcpy(&value, &x, 4);
+			return value;
+		}
+
+		static inline void FromFloat(BFloat16* dest, const float* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = FromFloat(source[i]);
+		}
+
+		static inline void ToFloat(float* dest, const BFloat16* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = source[i].ToFloat();
+		}
+	};
+}
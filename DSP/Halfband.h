@@ -0,0 +1,187 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <cmath>
+#include "Utils.h"
+#include "StateStream.h"
+
+namespace Cloudseed
+{
+	// Linear phase half-band lowpass for changing the sample rate by a factor of two.
+	// Every other tap of a half-band filter is zero apart from the centre tap of 0.5, so only the even taps are stored.
+	// Passes up to about 0.19 of the higher samplerate, stops from 0.31 up by about 70dB.
+	class Halfband
+	{
+	public:
+		static const int Taps = 47;
+		static const int EvenTaps = (Taps + 1) / 2;
+		static const int Center = Taps / 2; // also the group delay, in samples of the higher rate
+
+		// Blackman windowed sinc, scaled so the even taps sum to 0.5 and the DC gain is exactly 1
+		template<typename T>
+		static void Design(T* coeffs)
+		{
+			double sum = 0.0;
+			for (int k = 0; k < EvenTaps; k++)
+			{
+				int j = 2 * k;
+				double x = (j - Center) * M_PI * 0.5;
+				double window = 0.42 - 0.5 * std::cos(2 * M_PI * (j + 1) / (Taps + 1)) + 0.08 * std::cos(4 * M_PI * (j + 1) / (Taps + 1));
+				double value = 0.5 * std::sin(x) / x * window;
+				coeffs[k] = (T)value;
+				sum += value;
+			}
+
+			for (int k = 0; k < EvenTaps; k++)
+				coeffs[k] = (T)(coeffs[k] * 0.5 / sum);
+		}
+	};
+
+	// Halves the samplerate, keeping one output for every two samples of input
+	template<typename T>
+	class HalfbandDecimator
+	{
+	private:
+		T coeffs[Halfband::EvenTaps];
+		T history[2 * Halfband::Taps]; // written twice, so history[pos + k] is always the input from k samples ago
+		int pos;
+		bool odd;
+
+	public:
+		HalfbandDecimator()
+		{
+			Halfband::Design(coeffs);
+			ClearBuffers();
+		}
+
+		// Returns the number of samples written to output, half of bufSize give or take the one left over from the
+		// previous call. Output may be the same buffer as input.
+		int Process(const T* input, T* output, int bufSize)
+		{
+			int count = 0;
+			for (int i = 0; i < bufSize; i++)
+			{
+				pos = pos == 0 ? Halfband::Taps - 1 : pos - 1;
+				history[pos] = input[i];
+				history[pos + Halfband::Taps] = input[i];
+
+				odd = !odd;
+				if (odd)
+					continue;
+
+				const T* x = &history[pos];
+				T sum = 0.5f * x[Halfband::Center];
+				for (int k = 0; k < Halfband::EvenTaps; k++)
+					sum += coeffs[k] * x[2 * k];
+				output[count++] = sum;
+			}
+			return count;
+		}
+
+		void ClearBuffers()
+		{
+			Utils::ZeroBuffer(history, 2 * Halfband::Taps);
+			pos = 0;
+			odd = false;
+		}
+
+		void SaveState(StateWriter& writer)
+		{
+			writer.Write(history, 2 * Halfband::Taps);
+			writer.Write(pos);
+			writer.Write(odd);
+		}
+
+		void LoadState(StateReader& reader)
+		{
+			reader.Read(history, 2 * Halfband::Taps);
+			pos = reader.Read<int>();
+			odd = reader.Read<bool>();
+			if (pos < 0 || pos >= Halfband::Taps)
+				reader.Fail();
+		}
+	};
+
+	// Doubles the samplerate, writing two samples of output for every sample of input
+	template<typename T>
+	class HalfbandInterpolator
+	{
+	private:
+		static const int HistorySize = Halfband::EvenTaps;
+
+		T coeffs[Halfband::EvenTaps];
+		T history[2 * HistorySize]; // written twice, so history[pos + k] is always the input from k samples ago
+		int pos;
+
+	public:
+		HalfbandInterpolator()
+		{
+			Halfband::Design(coeffs);
+			for (int k = 0; k < Halfband::EvenTaps; k++)
+				coeffs[k] *= 2; // makes up for the zeros between the input samples
+			ClearBuffers();
+		}
+
+		// Writes 2 * bufSize samples to output, which must not overlap the input
+		void Process(const T* input, T* output, int bufSize)
+		{
+			for (int i = 0; i < bufSize; i++)
+			{
+				pos = pos == 0 ? HistorySize - 1 : pos - 1;
+				history[pos] = input[i];
+				history[pos + HistorySize] = input[i];
+
+				const T* x = &history[pos];
+				T sum = 0;
+				for (int k = 0; k < Halfband::EvenTaps; k++)
+					sum += coeffs[k] * x[k];
+				output[2 * i] = sum;
+				output[2 * i + 1] = x[Halfband::Center / 2]; // the centre tap is the only odd one, 2 * 0.5
+			}
+		}
+
+		void ClearBuffers()
+		{
+			Utils::ZeroBuffer(history, 2 * HistorySize);
+			pos = 0;
+		}
+
+		void SaveState(StateWriter& writer)
+		{
+			writer.Write(history, 2 * HistorySize);
+			writer.Write(pos);
+		}
+
+		void LoadState(StateReader& reader)
+		{
+			reader.Read(history, 2 * HistorySize);
+			pos = reader.Read<int>();
+			if (pos < 0 || pos >= HistorySize)
+				reader.Fail();
+		}
+	};
+}
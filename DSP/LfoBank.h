@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <cmath>
+#include "StateStream.h"
+
+namespace Cloudseed
+{
+	// A set of sine LFOs that advance in fixed steps of a whole number of samples.
+	// Each LFO is a unit vector rotated by a fixed angle per step (a quadrature oscillator),
+	// so advancing costs four multiplies per LFO instead of a sin and a fmod, and the loop over
+	// the LFOs has no dependencies between them, which lets the compiler vectorise it.
+	template<int Count>
+	class LfoBank
+	{
+	private:
+		float cosValue[Count];
+		float sinValue[Count];
+		float cosStep[Count];
+		float sinStep[Count];
+		float rate[Count];
+		int stepSize;
+
+	public:
+		LfoBank()
+		{
+			stepSize = 8;
+			for (int i = 0; i < Count; i++)
+			{
+				cosValue[i] = 1.0f;
+				sinValue[i] = 0.0f;
+				rate[i] = 0.0f;
+				UpdateStep(i);
+			}
+		}
+
+		// phase in cycles, 0 ... 1
+		void SetPhase(int i, float phase)
+		{
+			cosValue[i] = std::cos(phase * 2 * M_PI);
+			sinValue[i] = std::sin(phase * 2 * M_PI);
+		}
+
+		// rate in cycles per sample
+		void SetRate(int i, float ratePerSample)
+		{
+			if (rate[i] == ratePerSample)
+				return;
+			rate[i] = ratePerSample;
+			UpdateStep(i);
+		}
+
+		// Takes over the rates of another bank, keeping this bank's phases and step size
+		void CopyRates(const LfoBank& source)
+		{
+			for (int i = 0; i < Count; i++)
+			{
+				rate[i] = source.rate[i];
+				if (stepSize == source.stepSize)
+				{
+					cosStep[i] = source.cosStep[i];
+					sinStep[i] = source.sinStep[i];
+				}
+				else
+				{
+					UpdateStep(i);
+				}
+			}
+		}
+
+		// Phases, rates and step size
+		void SaveState(StateWriter& writer)
+		{
+			writer.Write(cosValue, Count);
+			writer.Write(sinValue, Count);
+			writer.Write(cosStep, Count);
+			writer.Write(sinStep, Count);
+			writer.Write(rate, Count);
+			writer.Write(stepSize);
+		}
+
+		void LoadState(StateReader& reader)
+		{
+			reader.Read(cosValue, Count);
+			reader.Read(sinValue, Count);
+			reader.Read(cosStep, Count);
+			reader.Read(sinStep, Count);
+			reader.Read(rate, Count);
+			stepSize = reader.Read<int>();
+			if (stepSize < 1)
+				reader.Fail();
+		}
+
+		int GetStepSize()
+		{
+			return stepSize;
+		}
+
+		// Number of samples each call to Advance moves the LFOs forward by
+		void SetStepSize(int samples)
+		{
+			stepSize = samples < 1 ? 1 : samples;
+			for (int i = 0; i < Count; i++)
+				UpdateStep(i);
+		}
+
+		inline void Advance()
+		{
+			for (int i = 0; i < Count; i++)
+			{
+				float c = cosValue[i] * cosStep[i] - sinValue[i] * sinStep[i];
+				float s = sinValue[i] * cosStep[i] + cosValue[i] * sinStep[i];
+				// pulls the vector back onto the unit circle, so rounding errors can't make the amplitude drift
+				float g = 1.5f - 0.5f * (c * c + s * s);
+				cosValue[i] = c * g;
+				sinValue[i] = s * g;
+			}
+		}
+
+		inline float GetSin(int i)
+		{
+			return sinValue[i];
+		}
+
+	private:
+		void UpdateStep(int i)
+		{
+			double angle = rate[i] * stepSize * 2 * M_PI;
+			cosStep[i] = (float)std::cos(angle);
+			sinStep[i] = (float)std::sin(angle);
+		}
+	};
+}
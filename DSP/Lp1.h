@@ -22,20 +22,24 @@ THE SOFTWARE.
 
 #pragma once
 
+#ifndef _USE_MATH_DEFINES
 #define _USE_MATH_DEFINES
+#endif
 #include <cmath>
+#include "StateStream.h"
 
 namespace Cloudseed
 {
+	template<typename T>
 	class Lp1
 	{
 	private:
 		float fs;
-		float b0, a1;
+		T b0, a1;
 		float cutoffHz;
 
 	public:
-		float Output;
+		T Output;
 
 		Lp1()
 		{
@@ -55,6 +59,15 @@ namespace Cloudseed
 			fs = samplerate;
 		}
 
+		// Takes over the samplerate, cutoff and coefficients of another filter, keeping this filter's state
+		void CopySettings(const Lp1& source)
+		{
+			fs = source.fs;
+			cutoffHz = source.cutoffHz;
+			b0 = source.b0;
+			a1 = source.a1;
+		}
+
 		float GetCutoffHz()
 		{
 			return cutoffHz;
@@ -71,6 +84,26 @@ namespace Cloudseed
 			Output = 0;
 		}
 
+		void SaveState(StateWriter& writer)
+		{
+			writer.Write(Output);
+		}
+
+		void LoadState(StateReader& reader)
+		{
+			Output = reader.Read<T>();
+		}
+
+		T GetB0()
+		{
+			return b0;
+		}
+
+		T GetA1()
+		{
+			return a1;
+		}
+
 		void Update()
 		{
 			// Prevent going over the Nyquist frequency
@@ -78,14 +111,14 @@ namespace Cloudseed
 				cutoffHz = fs * 0.499f;
 
 			auto x = 2.0f * M_PI * cutoffHz / fs;
-			auto nn = (2.0f - cosf(x));
-			auto alpha = nn - sqrtf(nn * nn - 1);
+			T nn = 2 - std::cos((T)x);
+			T alpha = nn - std::sqrt(nn * nn - 1);
 
 			a1 = alpha;
 			b0 = 1 - alpha;
 		}
 
-		float Process(float input)
+		T Process(T input)
 		{
 			if (input == 0 && Output < 0.0000001f)
 			{
@@ -98,7 +131,7 @@ namespace Cloudseed
 			return Output;
 		}
 
-		void Process(float* input, float* output, int len)
+		void Process(const T* input, T* output, int len)
 		{
 			for (int i = 0; i < len; i++)
 				output[i] = Process(input[i]);
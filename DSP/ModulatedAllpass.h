@@ -24,43 +24,52 @@ THE SOFTWARE.
 
 #include "ModulatedAllpass.h"
 #include "Utils.h"
+#include "LfoBank.h"
+#include "RingSpan.h"
+#include "SampleStorage.h"
+#include "StateStream.h"
+#include "LcgRandom.h"
 #include <cmath>
+#include <algorithm>
 
 namespace Cloudseed
 {
+	// T is the sample type, TStorage the type the history is stored as, see SampleStorage
+	template<typename T, typename TStorage = T>
 	class ModulatedAllpass
 	{
-	public:
-		static const int DelayBufferSize = 19200; // 100ms at 192Khz
-		static const int ModulationUpdateRate = 8;
-
 	private:
-		float delayBuffer[DelayBufferSize] = { 0 };
+		typedef SampleStorage<T, TStorage> Storage;
+
+		TStorage* delayBuffer;
+		int delayBufferSize; // a power of two
+		int mask;
 		int index;
 		uint64_t samplesProcessed;
 
-		float modPhase;
+		LfoBank<1> lfo;
 		int delayA;
 		int delayB;
-		float gainA;
-		float gainB;
+		T gainA;
+		T gainB;
 
 	public:
 
 		int SampleDelay;
-		float Feedback;
+		T Feedback;
 		float ModAmount;
-		float ModRate;
 
 		bool InterpolationEnabled;
 		bool ModulationEnabled;
 
 		ModulatedAllpass()
 		{
-			index = DelayBufferSize - 1;
+			delayBuffer = nullptr;
+			delayBufferSize = 0;
+			mask = 0;
+			index = 0;
 			samplesProcessed = 0;
 
-			modPhase = 0.01 + 0.98 * std::rand() / (float)RAND_MAX;
 			delayA = 0;
 			delayB = 0;
 			gainA = 0;
@@ -69,19 +78,138 @@ namespace Cloudseed
 			SampleDelay = 100;
 			Feedback = 0.5;
 			ModAmount = 0.0;
-			ModRate = 0.0;
 
 			InterpolationEnabled = true;
 			ModulationEnabled = true;
 			Update();
 		}
 
+		// Buffer size needed for a delay of up to maxDelaySamples, modulated by up to maxModAmount samples
+		static int GetBufferSize(float maxDelaySamples, float maxModAmount)
+		{
+			return RingSpan::Capacity((int)(maxDelaySamples + maxModAmount) + 2); // the second interpolation tap reads one sample further back
+		}
+
+		// The buffer is owned by the caller, and should hold GetBufferSize() samples. Only the largest power of two
+		// that fits is used. With a resampleRatio above 0, the history of the current buffer, which must still be valid,
+		// is carried over as if recorded at resampleRatio times the rate. Otherwise the new buffer starts out silent.
+		void SetBuffer(TStorage* buffer, int size, double resampleRatio = 0)
+		{
+			auto previous = delayBuffer;
+			auto previousMask = mask;
+			auto previousIndex = index;
+
+			delayBuffer = buffer;
+			delayBufferSize = RingSpan::CapacityWithin(size);
+			mask = delayBufferSize - 1;
+			index = delayBufferSize - 1;
+			ClearBuffers();
+			if (resampleRatio > 0 && previous != nullptr)
+				RingSpan::Resample<Storage>(previous, previousMask, previousIndex, delayBuffer, mask, index, GetLiveLength(), resampleRatio);
+			UpdateReadIndex();
+		}
+
 		void ClearBuffers()
 		{
-			Utils::ZeroBuffer(delayBuffer, DelayBufferSize);
+			Storage::Clear(delayBuffer, delayBufferSize);
+		}
+
+		// Takes over the delay, feedback and modulation settings of another allpass, keeping this allpass's buffer
+		// and LFO phase
+		void CopySettings(const ModulatedAllpass& source)
+		{
+			SampleDelay = source.SampleDelay;
+			Feedback = source.Feedback;
+			ModAmount = source.ModAmount;
+			InterpolationEnabled = source.InterpolationEnabled;
+			ModulationEnabled = source.ModulationEnabled;
+			lfo.CopyRates(source.lfo);
+			UpdateReadIndex();
+		}
+
+		// Samples of history the allpass can still read at its current settings, anything older is never read again.
+		// The mod amount is rounded up, see ModulatedDelay::GetLiveLength
+		int GetLiveLength()
+		{
+			int length = SampleDelay + (int)std::ceil(ModAmount) + 2;
+			return length < delayBufferSize ? length : delayBufferSize;
+		}
+
+		// The live part of the history, the read position and the LFO, see ModulatedDelay::SaveState
+		void SaveState(StateWriter& writer)
+		{
+			writer.WriteRing(delayBuffer, mask, index, GetStateLength());
+			writer.Write(delayA);
+			writer.Write(delayB);
+			writer.Write(gainA);
+			writer.Write(gainB);
+			writer.Write(samplesProcessed);
+			lfo.SaveState(writer);
+			writer.Write(SampleDelay);
+			writer.Write(ModAmount);
+		}
+
+		// Restores what SaveState wrote into a cleared allpass
+		void LoadState(StateReader& reader)
+		{
+			reader.ReadRing(delayBuffer, mask, index);
+			delayA = reader.Read<int>();
+			delayB = reader.Read<int>();
+			gainA = reader.Read<T>();
+			gainB = reader.Read<T>();
+			samplesProcessed = reader.Read<uint64_t>();
+			lfo.LoadState(reader);
+			SampleDelay = reader.Read<int>();
+			ModAmount = reader.Read<float>();
+			if (delayA < 0 || delayB < 0 || delayB >= delayBufferSize)
+				reader.Fail();
+		}
+
+		// rate in cycles per sample
+		void SetModRate(float rate)
+		{
+			lfo.SetRate(0, rate);
+		}
+
+		// Number of samples between updates of the modulated delay time
+		void SetModulationUpdateRate(int samples)
+		{
+			lfo.SetStepSize(samples);
+		}
+
+		// See ModulatedDelay::UpdateReadIndex
+		void UpdateReadIndex()
+		{
+			auto mod = lfo.GetSin(0);
+
+			float modAmount = ModAmount;
+			if (modAmount >= SampleDelay) // don't modulate to negative value
+				modAmount = SampleDelay - 1;
+
+			auto totalDelay = SampleDelay + modAmount * mod;
+
+			if (totalDelay <= 0) // should no longer be required
+				totalDelay = 1;
+			if (delayBufferSize > 0 && totalDelay > delayBufferSize - 2) // out of range settings, stay inside the buffer
+				totalDelay = delayBufferSize - 2;
+
+			delayA = (int)totalDelay;
+			delayB = (int)totalDelay + 1;
+
+			auto partial = totalDelay - delayA;
+
+			gainA = 1 - partial;
+			gainB = partial;
+		}
+
+		// Draws the starting phase of the modulation from random, see ReverbChannel::SetSeed
+		void RandomizeModPhase(LcgRandom& random)
+		{
+			lfo.SetPhase(0, 0.01 + 0.98 * random.NextFloat());
+			UpdateReadIndex();
 		}
 
-		void Process(float* input, float* output, int sampleCount)
+		void Process(const T* input, T* output, int sampleCount)
 		{
 			if (ModulationEnabled)
 				ProcessWithMod(input, output, sampleCount);
@@ -90,98 +218,90 @@ namespace Cloudseed
 		}
 
 	private:
-		void ProcessNoMod(float* input, float* output, int sampleCount)
+		// Without a delay, the whole buffer is read
+		int GetStateLength()
 		{
-			auto delayedIndex = index - SampleDelay;
-			if (delayedIndex < 0) delayedIndex += DelayBufferSize;
+			return SampleDelay > 0 ? GetLiveLength() : delayBufferSize;
+		}
 
-			for (int i = 0; i < sampleCount; i++)
-			{
-				auto bufOut = delayBuffer[delayedIndex];
-				auto inVal = input[i] + bufOut * Feedback;
+		// Runs in stretches where neither the write nor the read position wraps, and that are no longer than the delay,
+		// so nothing read in a stretch was written in it. The inner loop then has no branches and no loop carried dependency.
+		void ProcessNoMod(const T* input, T* output, int sampleCount)
+		{
+			auto sampleDelay = SampleDelay < delayBufferSize ? SampleDelay : delayBufferSize - 1;
+			if (sampleDelay <= 0) // reads the sample about to be overwritten, a full buffer ago
+				sampleDelay = delayBufferSize;
+			T feedback = Feedback;
 
-				delayBuffer[index] = inVal;
-				output[i] = bufOut - inVal * Feedback;
+			int i = 0;
+			while (i < sampleCount)
+			{
+				int readIndex = (index - sampleDelay) & mask;
+				int len = sampleCount - i;
+				if (len > sampleDelay) len = sampleDelay;
+				if (len > delayBufferSize - index) len = delayBufferSize - index;
+				if (len > delayBufferSize - readIndex) len = delayBufferSize - readIndex;
+
+				const T* in = &input[i];
+				T* out = &output[i];
+				const TStorage* read = &delayBuffer[readIndex];
+				TStorage* write = &delayBuffer[index];
+				for (int k = 0; k < len; k++)
+				{
+					T bufOut = Storage::Decode(read[k]);
+					T inVal = in[k] + bufOut * feedback;
+					write[k] = Storage::Encode(inVal);
+					out[k] = bufOut - inVal * feedback;
+				}
 
-				index++;
-				delayedIndex++;
-				if (index >= DelayBufferSize) index -= DelayBufferSize;
-				if (delayedIndex >= DelayBufferSize) delayedIndex -= DelayBufferSize;
-				samplesProcessed++;
+				i += len;
+				index = (index + len) & mask;
 			}
+			samplesProcessed += sampleCount;
 		}
 
-		void ProcessWithMod(float* input, float* output, int sampleCount)
+		void ProcessWithMod(const T* input, T* output, int sampleCount)
 		{
 			for (int i = 0; i < sampleCount; i++)
 			{
-				if (samplesProcessed >= ModulationUpdateRate)
+				if (samplesProcessed >= (uint64_t)lfo.GetStepSize())
 				{
 					Update();
 					samplesProcessed = 0;
 				}
 
-				float bufOut;
+				T bufOut;
 
 				if (InterpolationEnabled)
 				{
-					int idxA = index - delayA;
-					int idxB = index - delayB;
-					idxA += DelayBufferSize * (idxA < 0); // modulo
-					idxB += DelayBufferSize * (idxB < 0); // modulo
-
-					bufOut = delayBuffer[idxA] * gainA + delayBuffer[idxB] * gainB;
+					int idxA = (index - delayA) & mask;
+					int idxB = (index - delayB) & mask;
+					bufOut = Storage::Decode(delayBuffer[idxA]) * gainA + Storage::Decode(delayBuffer[idxB]) * gainB;
 				}
 				else
 				{
-					int idxA = index - delayA;
-					idxA += DelayBufferSize * (idxA < 0); // modulo
-					bufOut = delayBuffer[idxA];
+					int idxA = (index - delayA) & mask;
+					bufOut = Storage::Decode(delayBuffer[idxA]);
 				}
 
-				auto inVal = input[i] + bufOut * Feedback;
-				delayBuffer[index] = inVal;
+				T inVal = input[i] + bufOut * Feedback;
+				delayBuffer[index] = Storage::Encode(inVal);
 				output[i] = bufOut - inVal * Feedback;
 
-				index++;
-				if (index >= DelayBufferSize) index -= DelayBufferSize;
+				index = (index + 1) & mask;
 				samplesProcessed++;
 			}
 		}
 
-		inline float Get(int delay)
+		inline T Get(int delay)
 		{
-			int idx = index - delay;
-			if (idx < 0)
-				idx += DelayBufferSize;
-
-			return delayBuffer[idx];
+			return Storage::Decode(delayBuffer[(index - delay) & mask]);
 		}
 
 		void Update()
 		{
-			modPhase += ModRate * ModulationUpdateRate;
-			if (modPhase > 1)
-				modPhase = std::fmod(modPhase, 1.0);
-
-			auto mod = std::sinf(modPhase * 2 * M_PI);
-
-			if (ModAmount >= SampleDelay) // don't modulate to negative value
-				ModAmount = SampleDelay - 1;
-
-
-			auto totalDelay = SampleDelay + ModAmount * mod;
-
-			if (totalDelay <= 0) // should no longer be required
-				totalDelay = 1;
-
-			delayA = (int)totalDelay;
-			delayB = (int)totalDelay + 1;
-
-			auto partial = totalDelay - delayA;
-
-			gainA = 1 - partial;
-			gainB = partial;
+			lfo.Advance();
+			UpdateReadIndex();
 		}
 	};
 }
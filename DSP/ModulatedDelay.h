@@ -24,102 +24,237 @@ THE SOFTWARE.
 
 #include "ModulatedDelay.h"
 #include "Utils.h"
+#include "LfoBank.h"
+#include "RingSpan.h"
+#include "SampleStorage.h"
+#include "StateStream.h"
+#include "LcgRandom.h"
 #include <stdint.h>
+#include <cmath>
+#include <algorithm>
 
 namespace Cloudseed
 {
+	// T is the sample type, TStorage the type the history is stored as, see SampleStorage
+	template<typename T, typename TStorage = T>
 	class ModulatedDelay
 	{
 	private:
+		typedef SampleStorage<T, TStorage> Storage;
 
-		static const int ModulationUpdateRate = 8;
-		static const int DelayBufferSize = 192000 * 2;
-
-		float delayBuffer[DelayBufferSize] = { 0 };
+		TStorage* delayBuffer;
+		int delayBufferSize; // a power of two
+		int mask;
 		int writeIndex;
-		int readIndexA;
-		int readIndexB;
+		int delayA;
 		uint64_t samplesProcessed;
 
-		float modPhase;
-		float gainA;
-		float gainB;
+		LfoBank<1> lfo;
+		T gainA;
+		T gainB;
 
 	public:
 		int SampleDelay;
 
 		float ModAmount;
-		float ModRate;
 
 		ModulatedDelay()
 		{
+			delayBuffer = nullptr;
+			delayBufferSize = 0;
+			mask = 0;
 			writeIndex = 0;
-			readIndexA = 0;
-			readIndexB = 0;
+			delayA = 0;
 			samplesProcessed = 0;
 
-			modPhase = 0.01 + 0.98 * (std::rand() / (float)RAND_MAX);
 			gainA = 0;
 			gainB = 0;
 
 			SampleDelay = 100;
 			ModAmount = 0.0;
-			ModRate = 0.0;
 
 			Update();
 		}
 
-		void Process(float* input, float* output, int bufSize)
+		// Buffer size needed to delay by up to maxDelaySamples, modulated by up to maxModAmount samples, in blocks of up
+		// to maxBlockSize. The second interpolation tap reads one sample further back, and without modulation a whole
+		// block is written first. Lines that only borrow the sizing, and never write a block at once, pass 0.
+		static int GetBufferSize(float maxDelaySamples, float maxModAmount, int maxBlockSize = 0)
 		{
-			for (int i = 0; i < bufSize; i++)
-			{
-				if (samplesProcessed >= ModulationUpdateRate)
-				{
-					Update();
-					samplesProcessed = 0;
-				}
+			return RingSpan::Capacity((int)(maxDelaySamples + maxModAmount) + 2 + maxBlockSize);
+		}
 
-				delayBuffer[writeIndex] = input[i];
-				output[i] = delayBuffer[readIndexA] * gainA + delayBuffer[readIndexB] * gainB;
+		// The buffer is owned by the caller, and should hold GetBufferSize() samples. Only the largest power of two
+		// that fits is used. With a resampleRatio above 0, the history of the current buffer, which must still be valid,
+		// is carried over as if recorded at resampleRatio times the rate. Otherwise the new buffer starts out silent.
+		void SetBuffer(TStorage* buffer, int size, double resampleRatio = 0)
+		{
+			auto previous = delayBuffer;
+			auto previousMask = mask;
+			auto previousWrite = writeIndex;
 
-				writeIndex++;
-				readIndexA++;
-				readIndexB++;
-				if (writeIndex >= DelayBufferSize) writeIndex -= DelayBufferSize;
-				if (readIndexA >= DelayBufferSize) readIndexA -= DelayBufferSize;
-				if (readIndexB >= DelayBufferSize) readIndexB -= DelayBufferSize;
-				samplesProcessed++;
-			}
+			delayBuffer = buffer;
+			delayBufferSize = RingSpan::CapacityWithin(size);
+			mask = delayBufferSize - 1;
+			writeIndex = 0;
+			ClearBuffers();
+			if (resampleRatio > 0 && previous != nullptr)
+				RingSpan::Resample<Storage>(previous, previousMask, previousWrite, delayBuffer, mask, writeIndex, GetLiveLength(), resampleRatio);
+			UpdateReadIndex();
+		}
+
+		void Process(const T* input, T* output, int bufSize)
+		{
+			if (ModAmount == 0)
+				ProcessNoMod(input, output, bufSize);
+			else
+				ProcessWithMod(input, output, bufSize);
 		}
 
 		void ClearBuffers()
 		{
-			Utils::ZeroBuffer(delayBuffer, DelayBufferSize);
+			Storage::Clear(delayBuffer, delayBufferSize);
+		}
+
+		// Takes over the delay, modulation amount and rate of another delay, keeping this delay's buffer and LFO phase
+		void CopySettings(const ModulatedDelay& source)
+		{
+			SampleDelay = source.SampleDelay;
+			ModAmount = source.ModAmount;
+			lfo.CopyRates(source.lfo);
+			UpdateReadIndex();
 		}
 
+		// Samples of history the delay can still read at its current settings, anything older is never read again.
+		// The read position is rounded from SampleDelay + ModAmount * mod in float, which can land on the next
+		// whole sample, so the mod amount is rounded up.
+		int GetLiveLength()
+		{
+			int length = SampleDelay + (int)std::ceil(ModAmount) + 2;
+			return length < delayBufferSize ? length : delayBufferSize;
+		}
 
-	private:
-		void Update()
+		// The live part of the history, the read position and the LFO. The delay and modulation amount are included
+		// as well, so the restored read position and settings match.
+		void SaveState(StateWriter& writer)
+		{
+			writer.WriteRing(delayBuffer, mask, writeIndex, GetLiveLength());
+			writer.Write(delayA);
+			writer.Write(gainA);
+			writer.Write(gainB);
+			writer.Write(samplesProcessed);
+			lfo.SaveState(writer);
+			writer.Write(SampleDelay);
+			writer.Write(ModAmount);
+		}
+
+		// Restores what SaveState wrote into a cleared delay
+		void LoadState(StateReader& reader)
+		{
+			reader.ReadRing(delayBuffer, mask, writeIndex);
+			delayA = reader.Read<int>();
+			gainA = reader.Read<T>();
+			gainB = reader.Read<T>();
+			samplesProcessed = reader.Read<uint64_t>();
+			lfo.LoadState(reader);
+			SampleDelay = reader.Read<int>();
+			ModAmount = reader.Read<float>();
+			if (delayA < 0 || delayA > delayBufferSize - 2)
+				reader.Fail();
+		}
+
+		// rate in cycles per sample
+		void SetModRate(float rate)
 		{
-			modPhase += ModRate * ModulationUpdateRate;
-			if (modPhase > 1)
-				modPhase = std::fmod(modPhase, 1.0);
+			lfo.SetRate(0, rate);
+		}
+
+		// Number of samples between updates of the modulated delay time
+		void SetModulationUpdateRate(int samples)
+		{
+			lfo.SetStepSize(samples);
+		}
 
-			auto mod = std::sinf(modPhase * 2 * M_PI);
+		// Recomputes the read position from SampleDelay, ModAmount and the LFO. Call it after changing either, so the
+		// change takes effect right away rather than on the next modulation update, whatever order things are set in.
+		void UpdateReadIndex()
+		{
+			auto mod = lfo.GetSin(0);
 			auto totalDelay = SampleDelay + ModAmount * mod;
+			if (delayBufferSize > 0 && totalDelay > delayBufferSize - 2) // out of range settings, stay inside the buffer
+				totalDelay = delayBufferSize - 2;
 
-			auto delayA = (int)totalDelay;
-			auto delayB = (int)totalDelay + 1;
+			delayA = (int)totalDelay;
 
 			auto partial = totalDelay - delayA;
 
 			gainA = 1 - partial;
 			gainB = partial;
+		}
+
+		// Draws the starting phase of the modulation from random, see ReverbChannel::SetSeed
+		void RandomizeModPhase(LcgRandom& random)
+		{
+			lfo.SetPhase(0, 0.01 + 0.98 * random.NextFloat());
+			UpdateReadIndex();
+		}
+
+
+	private:
+		// A plain delay by a whole number of samples: the block is copied in, then the delayed block copied out,
+		// each in at most two contiguous runs. Works in place.
+		void ProcessNoMod(const T* input, T* output, int bufSize)
+		{
+			int delay = SampleDelay;
+			if (delay > delayBufferSize - bufSize) // out of range settings, stay inside the buffer
+				delay = delayBufferSize - bufSize;
+			if (delay < 0)
+				delay = 0;
+
+			RingSpan::ForEach(writeIndex, bufSize, mask, [&](int pos, int offset, int len)
+			{
+				Storage::Store(&delayBuffer[pos], &input[offset], len);
+			});
+			RingSpan::ForEach(writeIndex - delay, bufSize, mask, [&](int pos, int offset, int len)
+			{
+				Storage::Load(&output[offset], &delayBuffer[pos], len);
+			});
+			writeIndex = (writeIndex + bufSize) & mask;
+
+			// keep the LFO running, so the phase is where it would have been if modulation is switched on
+			samplesProcessed += bufSize;
+			while (samplesProcessed >= (uint64_t)lfo.GetStepSize())
+			{
+				lfo.Advance();
+				samplesProcessed -= lfo.GetStepSize();
+			}
+			UpdateReadIndex();
+		}
 
-			readIndexA = writeIndex - delayA;
-			readIndexB = writeIndex - delayB;
-			if (readIndexA < 0) readIndexA += DelayBufferSize;
-			if (readIndexB < 0) readIndexB += DelayBufferSize;
+		void ProcessWithMod(const T* input, T* output, int bufSize)
+		{
+			for (int i = 0; i < bufSize; i++)
+			{
+				if (samplesProcessed >= (uint64_t)lfo.GetStepSize())
+				{
+					Update();
+					samplesProcessed = 0;
+				}
+
+				delayBuffer[writeIndex] = Storage::Encode(input[i]);
+				int idxA = (writeIndex - delayA) & mask;
+				int idxB = (idxA - 1) & mask;
+				output[i] = Storage::Decode(delayBuffer[idxA]) * gainA + Storage::Decode(delayBuffer[idxB]) * gainB;
+
+				writeIndex = (writeIndex + 1) & mask;
+				samplesProcessed++;
+			}
+		}
+
+		void Update()
+		{
+			lfo.Advance();
+			UpdateReadIndex();
 		}
 	};
 }
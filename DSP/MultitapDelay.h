@@ -26,28 +26,45 @@ THE SOFTWARE.
 #include <memory>
 #include <array>
 #include <cmath>
+#include <string.h>
+#include <type_traits>
 #include "Utils.h"
 #include "RandomBuffer.h"
+#include "RingSpan.h"
+#include "SampleStorage.h"
+#include "StateStream.h"
 
 namespace Cloudseed
 {
+	// T is the sample type, TStorage the type the history is stored as, see SampleStorage
+	template<typename T, typename TStorage = T>
 	class MultitapDelay
 	{
 	public:
 		static const int MaxTaps = 256;
-		static const int DelayBufferSize = 192000 * 2;
 
 	private:
-		float delayBuffer[DelayBufferSize] = { 0 };
+		static const int DecodeRun = 64;
+
+		typedef SampleStorage<T, TStorage> Storage;
+
+		TStorage* delayBuffer;
+		int delayBufferSize; // a power of two
+		int mask;
+		int maxBlockSize;
 
 		float tapGains[MaxTaps] = { 0 };
 		float tapPosition[MaxTaps] = { 0 };
 
-		std::vector<float> seedValues;
+		// Derived per-tap table, rebuilt only when the seed, count, length or decay changes
+		int tapOffset[MaxTaps] = { 0 };
+		T tapGainEffective[MaxTaps] = { 0 };
+
+		RandomSeries<MaxTaps * 3> seedValues;
 
 		int writeIdx;
 		int seed;
-		float crossSeed;
+		CrossSeed crossSeed;
 		int count;
 		float lengthSamples;
 		float decay;
@@ -55,9 +72,12 @@ namespace Cloudseed
 	public:
 		MultitapDelay()
 		{
+			delayBuffer = nullptr;
+			delayBufferSize = 0;
+			mask = 0;
+			maxBlockSize = 0;
 			writeIdx = 0;
 			seed = 0;
-			crossSeed = 0.0;
 			count = 1;
 			lengthSamples = 1000;
 			decay = 1.0;
@@ -65,13 +85,39 @@ namespace Cloudseed
 			UpdateSeeds();
 		}
 
+		// Buffer size needed for taps spread over up to maxLengthSamples, in blocks of up to maxBlockSize
+		static int GetBufferSize(float maxLengthSamples, int maxBlockSize)
+		{
+			return RingSpan::Capacity((int)maxLengthSamples + maxBlockSize + 1); // a whole block is written before the taps are read
+		}
+
+		// The buffer is owned by the caller, and should hold GetBufferSize() samples. Only the largest power of two
+		// that fits is used. Process must not be called with more than maxBlockSize samples.
+		// resampleRatio carries the history over, see ModulatedDelay::SetBuffer
+		void SetBuffer(TStorage* buffer, int size, int maxBlockSize, double resampleRatio = 0)
+		{
+			auto previous = delayBuffer;
+			auto previousMask = mask;
+			auto previousWrite = writeIdx;
+
+			delayBuffer = buffer;
+			delayBufferSize = RingSpan::CapacityWithin(size);
+			mask = delayBufferSize - 1;
+			this->maxBlockSize = maxBlockSize;
+			writeIdx = 0;
+			ClearBuffers();
+			if (resampleRatio > 0 && previous != nullptr)
+				RingSpan::Resample<Storage>(previous, previousMask, previousWrite, delayBuffer, mask, writeIdx, GetLiveLength(), resampleRatio);
+			UpdateTaps();
+		}
+
 		void SetSeed(int seed)
 		{
 			this->seed = seed;
 			UpdateSeeds();
 		}
 
-		void SetCrossSeed(float crossSeed)
+		void SetCrossSeed(const CrossSeed& crossSeed)
 		{
 			this->crossSeed = crossSeed;
 			UpdateSeeds();
@@ -81,51 +127,106 @@ namespace Cloudseed
 		{
 			if (tapCount < 1) tapCount = 1;
 			count = tapCount;
-			Update();
+			UpdateTaps();
 		}
 
 		void SetTapLength(int tapLengthSamples)
 		{
 			if (tapLengthSamples < 10) tapLengthSamples = 10;
 			lengthSamples = tapLengthSamples;
-			Update();
+			UpdateTaps();
 		}
 
 		void SetTapDecay(float tapDecay)
 		{
 			decay = tapDecay;
+			UpdateTaps();
 		}
 
-		void Process(float* input, float* output, int bufSize)
+		void Process(const T* input, T* output, int bufSize)
 		{
-			float lengthScaler = lengthSamples / (float)count;
-			float totalGain = 3.0 / std::sqrtf(1 + count);
-			totalGain *= (1 + decay * 2);
-
-			for (int i = 0; i < bufSize; i++)
+			// Write the whole block first, every tap then reads a contiguous run of the buffer.
+			// The longest tap is far shorter than the buffer, so this never overwrites history that is still needed.
+			RingSpan::ForEach(writeIdx, bufSize, mask, [&](int pos, int offset, int len)
 			{
-				delayBuffer[writeIdx] = input[i];
-				output[i] = 0;
+				Storage::Store(&delayBuffer[pos], &input[offset], len);
+			});
 
-				for (int j = 0; j < count; j++)
-				{
-					float offset = tapPosition[j] * lengthScaler;
-					float decayEffective = std::expf(-offset / lengthSamples * 3.3) * decay + (1-decay);
-					int readIdx = writeIdx - (int)offset;
-					if (readIdx < 0) readIdx += DelayBufferSize;
+			Utils::ZeroBuffer(output, bufSize);
 
-					output[i] += delayBuffer[readIdx] * tapGains[j] * decayEffective * totalGain;
-				}
+			for (int j = 0; j < count; j++)
+			{
+				T gain = tapGainEffective[j];
+				RingSpan::ForEach(writeIdx - tapOffset[j], bufSize, mask, [&](int pos, int offset, int len)
+				{
+					const TStorage* src = &delayBuffer[pos];
+					T* dest = &output[offset];
+					if (std::is_same<T, TStorage>::value)
+					{
+						for (int k = 0; k < len; k++)
+							dest[k] += Storage::Decode(src[k]) * gain;
+						return;
+					}
 
-				writeIdx = (writeIdx + 1) % DelayBufferSize;
+					// Narrower storage is decoded in short runs first, so the conversion vectorises as well
+					T decoded[DecodeRun];
+					for (int k = 0; k < len; k += DecodeRun)
+					{
+						int run = len - k < DecodeRun ? len - k : DecodeRun;
+						Storage::Load(decoded, &src[k], run);
+						for (int i = 0; i < run; i++)
+							dest[k + i] += decoded[i] * gain;
+					}
+				});
 			}
+
+			writeIdx = (writeIdx + bufSize) & mask;
 		}
 
 		void ClearBuffers()
 		{
-			Utils::ZeroBuffer(delayBuffer, DelayBufferSize);
+			Storage::Clear(delayBuffer, delayBufferSize);
 		}
 
+		// Takes over the seed tables and the derived tap table of another multitap delay, keeping this delay's buffer.
+		// Costs a copy of the tables instead of regenerating them.
+		void CopySettings(const MultitapDelay& source)
+		{
+			memcpy(tapGains, source.tapGains, sizeof(tapGains));
+			memcpy(tapPosition, source.tapPosition, sizeof(tapPosition));
+			memcpy(tapOffset, source.tapOffset, sizeof(tapOffset));
+			memcpy(tapGainEffective, source.tapGainEffective, sizeof(tapGainEffective));
+			seedValues = source.seedValues;
+			seed = source.seed;
+			crossSeed = source.crossSeed;
+			count = source.count;
+			lengthSamples = source.lengthSamples;
+			decay = source.decay;
+
+			int maxOffset = delayBufferSize - maxBlockSize - 1;
+			for (int j = 0; j < count && delayBufferSize > 0; j++)
+				if (tapOffset[j] > maxOffset) // the source may have no buffer, stay inside this one
+					tapOffset[j] = maxOffset;
+		}
+
+		// Samples of history the taps can still read at their current settings, anything older is never read again
+		int GetLiveLength()
+		{
+			int length = (int)lengthSamples + 2; // every tap sits within the tap length
+			return length < delayBufferSize ? length : delayBufferSize;
+		}
+
+		// Only the live part of the history, the taps are derived from the parameters
+		void SaveState(StateWriter& writer)
+		{
+			writer.WriteRing(delayBuffer, mask, writeIdx, GetLiveLength());
+		}
+
+		// Restores what SaveState wrote into a cleared delay
+		void LoadState(StateReader& reader)
+		{
+			reader.ReadRing(delayBuffer, mask, writeIdx);
+		}
 
 	private:
 		void Update()
@@ -139,12 +240,32 @@ namespace Cloudseed
 				tapGains[i] = Utils::DB2Gainf(-20 + rand() * 20) * phase;
 				tapPosition[i] = i + rand();
 			}
+
+			UpdateTaps();
+		}
+
+		void UpdateTaps()
+		{
+			float lengthScaler = lengthSamples / (float)count;
+			float totalGain = 3.0 / std::sqrtf(1 + count);
+			totalGain *= (1 + decay * 2);
+			int maxOffset = delayBufferSize - maxBlockSize - 1;
+
+			for (int j = 0; j < count; j++)
+			{
+				float offset = tapPosition[j] * lengthScaler;
+				float decayEffective = std::expf(-offset / lengthSamples * 3.3) * decay + (1 - decay);
+				tapOffset[j] = (int)offset;
+				if (delayBufferSize > 0 && tapOffset[j] > maxOffset) // out of range settings, stay inside the buffer
+					tapOffset[j] = maxOffset;
+				tapGainEffective[j] = tapGains[j] * decayEffective * totalGain;
+			}
 		}
 
 		void UpdateSeeds()
 		{
-			this->seedValues = RandomBuffer::Generate(seed, MaxTaps * 3, crossSeed);
-			Update();
+			if (seedValues.Generate(seed, MaxTaps * 3, crossSeed))
+				Update();
 		}
 	};
 }
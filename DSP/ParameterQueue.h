@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace Cloudseed
+{
+	struct ParameterEvent
+	{
+		int ParamId;
+		double Value;
+		uint64_t SampleTime; // absolute sample position at which the change takes effect
+	};
+
+	// Single producer, single consumer queue of parameter changes, posted by a control thread and drained by the
+	// audio thread. Wait-free on both ends and nothing is allocated after construction. Events are consumed in
+	// the order they were posted, so the producer should post them in non-decreasing SampleTime order.
+	class ParameterQueue
+	{
+	public:
+		static const int Capacity = 1024; // must be a power of two
+
+	private:
+		static const uint32_t Mask = Capacity - 1;
+
+		ParameterEvent events[Capacity];
+		std::atomic<uint32_t> writeCount;
+		char padding[64 - sizeof(std::atomic<uint32_t>)]; // keep the two counters on separate cache lines
+		std::atomic<uint32_t> readCount;
+
+	public:
+		ParameterQueue() :
+			writeCount(0),
+			readCount(0)
+		{
+		}
+
+		// Producer side. Returns false and drops the event if the queue is full.
+		bool Push(const ParameterEvent& ev)
+		{
+			auto write = writeCount.load(std::memory_order_relaxed);
+			if (write - readCount.load(std::memory_order_acquire) >= (uint32_t)Capacity)
+				return false;
+
+			events[write & Mask] = ev;
+			writeCount.store(write + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side. Copies the oldest event without removing it, returns false if the queue is empty.
+		bool Peek(ParameterEvent& ev)
+		{
+			auto read = readCount.load(std::memory_order_relaxed);
+			if (read == writeCount.load(std::memory_order_acquire))
+				return false;
+
+			ev = events[read & Mask];
+			return true;
+		}
+
+		// Consumer side. Removes the oldest event, only valid after a successful Peek.
+		void Pop()
+		{
+			readCount.store(readCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+}
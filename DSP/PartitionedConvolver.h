@@ -0,0 +1,334 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include "Fft.h"
+#include "Utils.h"
+#include "StateStream.h"
+
+namespace Cloudseed
+{
+	// Zero latency convolution with a long impulse response, split into non-uniform partitions.
+	// The first HeadSize taps are applied directly in the time domain, sample by sample. The rest is covered by
+	// levels of uniformly partitioned overlap-save FFT convolution, each with four times the block size of the
+	// one before, up to the given maximum: short blocks where latency matters, long blocks for the cheap bulk of the tail.
+	// A level's result for its next block of output only needs input that has already arrived, so nothing is delayed.
+	template<typename T>
+	class PartitionedConvolver
+	{
+	public:
+		static const int HeadSize = 64;
+
+	private:
+		// One uniformly partitioned level, covering the impulse from blockSize up to its length
+		class Level
+		{
+		private:
+			int blockSize;
+			int partitionCount; // partitions after the first, which belongs to the previous level or the head
+			int bins;
+			Fft<T> fft;
+
+			std::vector<T> partitionsRe;	// spectra of the impulse partitions
+			std::vector<T> partitionsIm;
+			std::vector<T> historyRe;		// spectra of past input, newest first after rotation
+			std::vector<T> historyIm;
+			int historyIndex;
+
+			std::vector<T> input;			// previous and current block of input
+			std::vector<T> output;			// output for the current block
+			std::vector<T> sumRe;
+			std::vector<T> sumIm;
+			std::vector<T> timeBuffer;
+			int position;
+
+		public:
+			void SetImpulse(const T* impulse, int length, int blockSize)
+			{
+				this->blockSize = blockSize;
+				partitionCount = (length + blockSize - 1) / blockSize - 1;
+				bins = blockSize + 1;
+				fft.SetSize(2 * blockSize);
+
+				partitionsRe.assign((size_t)partitionCount * bins, 0.0f);
+				partitionsIm.assign((size_t)partitionCount * bins, 0.0f);
+				timeBuffer.assign(2 * blockSize, 0.0f);
+				for (int p = 0; p < partitionCount; p++)
+				{
+					int start = (p + 1) * blockSize;
+					Utils::ZeroBuffer(timeBuffer.data(), 2 * blockSize);
+					for (int i = 0; i < blockSize && start + i < length; i++)
+						timeBuffer[i] = impulse[start + i];
+					fft.Forward(timeBuffer.data(), &partitionsRe[(size_t)p * bins], &partitionsIm[(size_t)p * bins]);
+				}
+
+				historyRe.assign((size_t)partitionCount * bins, 0.0f);
+				historyIm.assign((size_t)partitionCount * bins, 0.0f);
+				input.assign(2 * blockSize, 0.0f);
+				output.assign(blockSize, 0.0f);
+				sumRe.assign(bins, 0.0f);
+				sumIm.assign(bins, 0.0f);
+				ClearBuffers();
+			}
+
+			// Takes one sample of input and returns this level's share of the output for it
+			inline T Process(T in)
+			{
+				input[blockSize + position] = in;
+				T out = output[position];
+				position++;
+				if (position == blockSize)
+					NextBlock();
+				return out;
+			}
+
+			void ClearBuffers()
+			{
+				Utils::ZeroBuffer(historyRe.data(), (int)historyRe.size());
+				Utils::ZeroBuffer(historyIm.data(), (int)historyIm.size());
+				Utils::ZeroBuffer(input.data(), (int)input.size());
+				Utils::ZeroBuffer(output.data(), (int)output.size());
+				historyIndex = 0;
+				position = 0;
+			}
+
+			// The impulse partitions and the input history, both as spectra
+			void SaveState(StateWriter& writer)
+			{
+				writer.Write(blockSize);
+				writer.Write(partitionCount);
+				writer.Write(partitionsRe.data(), partitionCount * bins);
+				writer.Write(partitionsIm.data(), partitionCount * bins);
+				writer.Write(historyRe.data(), partitionCount * bins);
+				writer.Write(historyIm.data(), partitionCount * bins);
+				writer.Write(historyIndex);
+				writer.Write(input.data(), 2 * blockSize);
+				writer.Write(output.data(), blockSize);
+				writer.Write(position);
+			}
+
+			void LoadState(StateReader& reader)
+			{
+				blockSize = reader.Read<int>();
+				partitionCount = reader.Read<int>();
+				bins = blockSize + 1;
+				size_t values = (size_t)partitionCount * bins * 4 + (size_t)blockSize * 3;
+				if (blockSize < HeadSize || blockSize > (1 << 24) || (blockSize & (blockSize - 1)) != 0
+					|| partitionCount < 1 || values * sizeof(T) > reader.GetRemaining())
+				{
+					reader.Fail();
+					return;
+				}
+
+				fft.SetSize(2 * blockSize);
+				partitionsRe.resize((size_t)partitionCount * bins);
+				partitionsIm.resize((size_t)partitionCount * bins);
+				historyRe.resize((size_t)partitionCount * bins);
+				historyIm.resize((size_t)partitionCount * bins);
+				input.resize(2 * blockSize);
+				output.resize(blockSize);
+				sumRe.assign(bins, 0.0f);
+				sumIm.assign(bins, 0.0f);
+				timeBuffer.assign(2 * blockSize, 0.0f);
+				reader.Read(partitionsRe.data(), partitionCount * bins);
+				reader.Read(partitionsIm.data(), partitionCount * bins);
+				reader.Read(historyRe.data(), partitionCount * bins);
+				reader.Read(historyIm.data(), partitionCount * bins);
+				historyIndex = reader.Read<int>();
+				reader.Read(input.data(), 2 * blockSize);
+				reader.Read(output.data(), blockSize);
+				position = reader.Read<int>();
+				if (historyIndex < 0 || historyIndex >= partitionCount || position < 0 || position >= blockSize)
+					reader.Fail();
+			}
+
+		private:
+			void NextBlock()
+			{
+				position = 0;
+
+				// spectrum of the last two blocks of input, the newest entry of the delay line
+				historyIndex = historyIndex == 0 ? partitionCount - 1 : historyIndex - 1;
+				fft.Forward(input.data(), &historyRe[(size_t)historyIndex * bins], &historyIm[(size_t)historyIndex * bins]);
+
+				// impulse partition p + 1 meets the input spectrum from p blocks ago
+				Utils::ZeroBuffer(sumRe.data(), bins);
+				Utils::ZeroBuffer(sumIm.data(), bins);
+				int h = historyIndex;
+				for (int p = 0; p < partitionCount; p++)
+				{
+					const T* xr = &historyRe[(size_t)h * bins];
+					const T* xi = &historyIm[(size_t)h * bins];
+					const T* hr = &partitionsRe[(size_t)p * bins];
+					const T* hi = &partitionsIm[(size_t)p * bins];
+					T* sr = sumRe.data();
+					T* si = sumIm.data();
+					for (int k = 0; k < bins; k++)
+					{
+						sr[k] += xr[k] * hr[k] - xi[k] * hi[k];
+						si[k] += xr[k] * hi[k] + xi[k] * hr[k];
+					}
+					h++;
+					if (h == partitionCount)
+						h = 0;
+				}
+
+				// overlap-save, the second half is the valid part
+				fft.Inverse(sumRe.data(), sumIm.data(), timeBuffer.data());
+				Utils::Copy(output.data(), &timeBuffer[blockSize], blockSize);
+				Utils::Copy(input.data(), &input[blockSize], blockSize);
+			}
+		};
+
+		int length;
+		int headLength;
+		std::vector<T> headReversed;	// head of the impulse response, reversed for the direct part
+		std::vector<T> headInput;		// previous and current HeadSize samples of input
+		int headPosition;
+		std::vector<Level> levels;
+
+	public:
+		PartitionedConvolver()
+		{
+			length = 0;
+			headLength = 0;
+			headPosition = 0;
+		}
+
+		// Allocates, so call this from a non-realtime thread. maxBlockSize must be a power of two, HeadSize or larger.
+		// Larger blocks make long responses cheaper on average, but concentrate more work on the samples where
+		// the longest level finishes a block.
+		void SetImpulse(const T* impulse, int length, int maxBlockSize)
+		{
+			this->length = length;
+			headLength = length < HeadSize ? length : HeadSize;
+			headReversed.assign(HeadSize, 0.0f);
+			for (int i = 0; i < headLength; i++)
+				headReversed[HeadSize - 1 - i] = impulse[i];
+			headInput.assign(2 * HeadSize, 0.0f);
+			headPosition = 0;
+
+			levels.clear();
+			int blockSize = HeadSize;
+			while (blockSize < length)
+			{
+				// each level ends where the next one starts, the last runs to the end of the impulse
+				int nextBlockSize = blockSize * 4 < maxBlockSize ? blockSize * 4 : maxBlockSize;
+				int end = nextBlockSize > blockSize && nextBlockSize < length ? nextBlockSize : length;
+
+				levels.push_back(Level());
+				levels.back().SetImpulse(impulse, end, blockSize);
+				if (end == length)
+					break;
+				blockSize = nextBlockSize;
+			}
+
+			ClearBuffers();
+		}
+
+		int GetLength()
+		{
+			return length;
+		}
+
+		// Sample i of the output is written to out[i * outStride]
+		void Process(const T* in, T* out, int bufSize, int outStride = 1)
+		{
+			int levelCount = (int)levels.size();
+			for (int i = 0; i < bufSize; i++)
+			{
+				headInput[HeadSize + headPosition] = in[i];
+
+				// direct part, impulse taps 0 ... HeadSize - 1, four running sums so the adds don't wait on each other
+				const T* x = &headInput[headPosition + 1];
+				const T* h = headReversed.data();
+				T sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+				for (int t = 0; t < HeadSize; t += 4)
+				{
+					sum0 += h[t] * x[t];
+					sum1 += h[t + 1] * x[t + 1];
+					sum2 += h[t + 2] * x[t + 2];
+					sum3 += h[t + 3] * x[t + 3];
+				}
+				T sum = (sum0 + sum1) + (sum2 + sum3);
+
+				for (int l = 0; l < levelCount; l++)
+					sum += levels[l].Process(in[i]);
+
+				out[i * outStride] = sum;
+
+				headPosition++;
+				if (headPosition == HeadSize)
+				{
+					Utils::Copy(headInput.data(), &headInput[HeadSize], HeadSize);
+					headPosition = 0;
+				}
+			}
+		}
+
+		void ClearBuffers()
+		{
+			Utils::ZeroBuffer(headInput.data(), (int)headInput.size());
+			headPosition = 0;
+			for (auto& level : levels)
+				level.ClearBuffers();
+		}
+
+		// The impulse response and the input history. There is no live region to cut down to, all of it is
+		// still needed, and it is stored in the form the convolver uses, so restoring needs no FFTs.
+		void SaveState(StateWriter& writer)
+		{
+			writer.Write(length);
+			writer.Write(headLength);
+			writer.Write(headReversed.data(), (int)headReversed.size());
+			writer.Write(headInput.data(), (int)headInput.size());
+			writer.Write(headPosition);
+			writer.Write((int)levels.size());
+			for (auto& level : levels)
+				level.SaveState(writer);
+		}
+
+		// Replaces the impulse response and the history with what SaveState wrote. Allocates.
+		void LoadState(StateReader& reader)
+		{
+			length = reader.Read<int>();
+			headLength = reader.Read<int>();
+			headReversed.assign(HeadSize, 0.0f);
+			headInput.assign(2 * HeadSize, 0.0f);
+			reader.Read(headReversed.data(), HeadSize);
+			reader.Read(headInput.data(), 2 * HeadSize);
+			headPosition = reader.Read<int>();
+			int levelCount = reader.Read<int>();
+			if (length < 0 || headPosition < 0 || headPosition >= HeadSize || levelCount < 0 || levelCount > 32)
+			{
+				reader.Fail();
+				return;
+			}
+
+			levels.assign(levelCount, Level());
+			for (auto& level : levels)
+				level.LoadState(reader);
+		}
+	};
+}
@@ -27,31 +27,71 @@ THE SOFTWARE.
 namespace Cloudseed
 {
 	std::vector<float> RandomBuffer::Generate(uint64_t seed, int count)
+	{
+		std::vector<float> output(count);
+		Fill(output.data(), seed, count);
+		return output;
+	}
+
+	std::vector<float> RandomBuffer::Generate(uint64_t seed, int count, float crossSeed)
+	{
+		std::vector<float> output(count);
+		Fill(output.data(), seed, count, crossSeed);
+		return output;
+	}
+
+	void RandomBuffer::Fill(float* output, uint64_t seed, int count)
 	{
 		LcgRandom rand(seed);
-		std::vector<float> output;
 
 		for (int i = 0; i < count; i++)
 		{
 			unsigned int val = rand.NextUInt();
-			float fVal = val / (float)UINT_MAX;
-			output.push_back(fVal);
+			output[i] = val / (float)UINT_MAX;
 		}
+	}
 
-		return output;
+	void RandomBuffer::Fill(float* output, uint64_t seed, int count, float crossSeed)
+	{
+		LcgRandom randA(seed);
+		LcgRandom randB(~seed);
+
+		for (int i = 0; i < count; i++)
+		{
+			float valA = randA.NextUInt() / (float)UINT_MAX;
+			float valB = randB.NextUInt() / (float)UINT_MAX;
+			output[i] = valA * (1 - crossSeed) + valB * crossSeed;
+		}
 	}
 
-	std::vector<float> RandomBuffer::Generate(uint64_t seed, int count, float crossSeed)
+	void RandomBuffer::Fill(float* output, uint64_t seed, int count, const CrossSeed& crossSeed)
 	{
-		auto seedA = seed;
-		auto seedB = ~seed;
-		auto seriesA = Generate(seedA, count);
-		auto seriesB = Generate(seedB, count);
+		if (crossSeed.ChannelCount <= 1)
+		{
+			Fill(output, seed, count);
+			return;
+		}
 
-		std::vector<float> output;
+		if (crossSeed.ChannelCount == 2)
+		{
+			float stereoCross = crossSeed.Channel == 0 ? 1 - 0.5 * crossSeed.Amount : 0.5 * crossSeed.Amount;
+			Fill(output, seed, count, stereoCross);
+			return;
+		}
+
+		// Channels 0 and 1 use the two stereo series, ~seed and seed, the rest a series of their own
+		float own = (float)(1 - crossSeed.Amount);
+		float shared = (float)(crossSeed.Amount / crossSeed.ChannelCount);
 		for (int i = 0; i < count; i++)
-			output.push_back(seriesA[i] * (1 - crossSeed) + seriesB[i] * crossSeed);
+			output[i] = 0;
 
-		return output;
+		for (int c = 0; c < crossSeed.ChannelCount; c++)
+		{
+			uint64_t channelSeed = c == 0 ? ~seed : c == 1 ? seed : seed ^ (c * 0x9E3779B97F4A7C15ull);
+			float gain = c == crossSeed.Channel ? own + shared : shared;
+			LcgRandom rand(channelSeed);
+			for (int i = 0; i < count; i++)
+				output[i] += rand.NextUInt() / (float)UINT_MAX * gain;
+		}
 	}
 }
@@ -27,10 +27,72 @@ THE SOFTWARE.
 
 namespace Cloudseed
 {
+	// How the random series of one channel relates to those of the other channels. Each channel has a series of
+	// its own, and Amount blends it towards the average of all of them: at 0 the channels are fully decorrelated,
+	// at 1 they all get the same values. A single channel always gets the plain series of the seed.
+	struct CrossSeed
+	{
+		double Amount = 0.0;
+		int Channel = 0;
+		int ChannelCount = 1;
+	};
+
 	class RandomBuffer
 	{
 	public:
 		static std::vector<float> Generate(uint64_t seed, int count);
 		static std::vector<float> Generate(uint64_t seed, int count, float crossSeed);
+
+		// Same series as Generate, written into caller provided storage of at least count floats
+		static void Fill(float* output, uint64_t seed, int count);
+		static void Fill(float* output, uint64_t seed, int count, float crossSeed);
+
+		// Series for one channel out of crossSeed.ChannelCount. Two channels give the same values as the
+		// stereo cross seed above, with the left channel at 1 - 0.5 * Amount and the right at 0.5 * Amount.
+		static void Fill(float* output, uint64_t seed, int count, const CrossSeed& crossSeed);
+	};
+
+	// Fixed storage for one random series. Regenerates only when the seed, count or cross seed actually change,
+	// so re-applying the same parameters costs nothing and never allocates.
+	template<int MaxCount>
+	class RandomSeries
+	{
+	private:
+		float values[MaxCount] = { 0 };
+		uint64_t seed;
+		int count;
+		CrossSeed crossSeed;
+		bool valid;
+
+	public:
+		RandomSeries()
+		{
+			seed = 0;
+			count = 0;
+			valid = false;
+		}
+
+		// Returns true if the values changed
+		bool Generate(uint64_t seed, int count, const CrossSeed& crossSeed)
+		{
+			if (count > MaxCount)
+				count = MaxCount;
+
+			if (valid && seed == this->seed && count == this->count && crossSeed.Amount == this->crossSeed.Amount
+				&& crossSeed.Channel == this->crossSeed.Channel && crossSeed.ChannelCount == this->crossSeed.ChannelCount)
+				return false;
+
+			RandomBuffer::Fill(values, seed, count, crossSeed);
+			this->seed = seed;
+			this->count = count;
+			this->crossSeed = crossSeed;
+			valid = true;
+			return true;
+		}
+
+		inline float operator[](int index) const
+		{
+			return values[index];
+		}
 	};
 }
@@ -24,18 +24,29 @@ THE SOFTWARE.
 
 #include <map>
 #include <memory>
+#include <algorithm>
 #include "../Parameters.h"
 #include "ModulatedDelay.h"
 #include "MultitapDelay.h"
 #include "RandomBuffer.h"
 #include "Lp1.h"
 #include "Hp1.h"
-#include "DelayLine.h"
+#include "DelayLineBank.h"
 #include "AllpassDiffuser.h"
+#include "StageTimer.h"
+#include "BufferArena.h"
+#include "Halfband.h"
+#include "StateStream.h"
+#include "LcgRandom.h"
 #include <cmath>
 #include "ReverbChannel.h"
 #include "Utils.h"
 
+// Maximum block size a channel is prepared for until Prepare is called
+#ifndef BUFFER_SIZE
+#define BUFFER_SIZE 1024
+#endif
+
 namespace Cloudseed
 {
 	enum class ChannelLR
@@ -44,21 +55,45 @@ namespace Cloudseed
 		Right
 	};
 
+	// T is the sample type the channel computes in, TStorage the type its delays store their history as,
+	// see SampleStorage
+	template<typename T, typename TStorage = T>
 	class ReverbChannel
 	{
 	private:
 		static const int TotalLineCount = 12;
+		static const int LineLanes = LATE_LINE_LANES;
+		static const int LineBankCount = (TotalLineCount + LineLanes - 1) / LineLanes;
+		typedef DelayLineBank<LineLanes, T, TStorage> LineBank;
 
 		double paramsScaled[Parameter::COUNT] = { 0.0 };
 		int samplerate;
-
-		ModulatedDelay preDelay;
-		MultitapDelay multitap;
-		AllpassDiffuser diffuser;
-		DelayLine lines[TotalLineCount];
+		int maxBlockSize;
+
+		// Scratch for one block, carved out of the arena next to the delay buffers, see Prepare
+		T* tempBuffer;
+		T* lineSumBuffer;
+		T* lateInputBuffer;
+		T* halfRateBuffer;
+
+		ModulatedDelay<T, TStorage> preDelay;
+		MultitapDelay<T, TStorage> multitap;
+		AllpassDiffuser<T, TStorage> diffuser;
+		LineBank lines[LineBankCount];
+		BufferArena arena;
+		BufferArena spareArena; // the previous buffers while a samplerate change carries their history over
+		size_t clearPosition; // bytes of the arena zeroed so far, see ClearBuffersStep
 		RandomBuffer rand;
-		Hp1 highPass;
-		Lp1 lowPass;
+		RandomSeries<TotalLineCount * 3> delayLineSeeds;
+		Hp1<T> highPass;
+		Lp1<T> lowPass;
+
+		// Late lines at a reduced rate, see SetLateDecimation
+		int lateDecimation;
+		HalfbandDecimator<T> lateDecimators[2];
+		HalfbandInterpolator<T> lateInterpolators[2];
+		T* lateOutput; // interpolated late output not yet consumed, the block can end mid-way through a reduced rate sample
+		int lateOutputCount;
 
 		int delayLineSeed;
 		int postDiffusionSeed;
@@ -71,23 +106,54 @@ namespace Cloudseed
 		bool multitapEnabled;
 		bool diffuserEnabled;
 		float inputMix;
-		float dryOut;
-		float earlyOut;
-		float lineOut;
-		float crossSeed;
-		ChannelLR channelLr;
+		T dryOut;
+		T earlyOut;
+		T lineOut;
+		CrossSeed crossSeed; // which of the decorrelated seed series this channel uses, see RandomBuffer
+		bool inputSquelch;
+		bool settingsOnly; // no buffers, see the constructor
+
+		// Sleep mode, see SetSleepMode
+		bool sleepEnabled;
+		bool sleeping;
+		float sleepThreshold;
+		float sleepHoldMillis;
+		int silentSamples;
 
 	public:
+		StageTimer Timer;
 
 		ReverbChannel(int samplerate, ChannelLR leftOrRight)
+			: ReverbChannel(samplerate, leftOrRight == ChannelLR::Left ? 0 : 1, 2)
+		{
+		}
+
+		// Channel channelIndex out of channelCount, each channel gets its own variation of the seeds.
+		// Channels 0 and 1 of 2 are the same as the left and right channel. Without buffers, the channel only
+		// holds settings to copy into others, see BasicReverbPreset, and must not be processed.
+		ReverbChannel(int samplerate, int channelIndex, int channelCount, bool withBuffers = true)
 		{
-			this->channelLr = leftOrRight;
-			crossSeed = 0.0;
+			settingsOnly = !withBuffers;
+			lateOutput = nullptr;
+			crossSeed.Channel = channelIndex;
+			crossSeed.ChannelCount = channelCount;
+			SetSeed(0);
 			lineCount = 8;
+			inputSquelch = true;
+			sleepEnabled = false;
+			sleeping = false;
+			sleepThreshold = Utils::DB2Gainf(-100);
+			sleepHoldMillis = 200;
+			silentSamples = 0;
+			clearPosition = 0;
+			lateDecimation = 1;
+			lateOutputCount = 0;
+			maxBlockSize = BUFFER_SIZE;
 			diffuser.SetInterpolationEnabled(true);
 			highPass.SetCutoffHz(20);
 			lowPass.SetCutoffHz(20000);
 			SetSamplerate(samplerate);
+			ReapplyAllParams();
 		}
 
 		int GetSamplerate()
@@ -95,19 +161,63 @@ namespace Cloudseed
 			return samplerate;
 		}
 
-		void SetSamplerate(int samplerate)
+		// Draws the starting phase of every modulated delay from seed, so channels with the same seed, channel index and
+		// parameters give the same output. Every channel index gets its own series of phases, so the channels stay
+		// decorrelated. Restarts the modulation, so call it before processing, or along with ClearBuffers.
+		void SetSeed(uint64_t seed)
+		{
+			// spreads the seed and channel over the generator's 32 bits of state (splitmix64 finaliser)
+			uint64_t z = seed + 0x9E3779B97F4A7C15ull * (uint64_t)(crossSeed.Channel + 1);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			LcgRandom random(z ^ (z >> 31));
+
+			preDelay.RandomizeModPhase(random);
+			diffuser.RandomizeModPhases(random);
+			for (int i = 0; i < LineBankCount; i++)
+				lines[i].RandomizeModPhases(random);
+		}
+
+		// Recomputes only what depends on the samplerate, the filter coefficients, delay lengths and modulation rates,
+		// and keeps the delay memory when it is large enough. The buffers are cleared, unless keepState is set:
+		// then the history of every delay is resampled to the new rate, so the tail carries on through the switch.
+		// That needs a second block of delay memory next to the first, which is kept for the next switch.
+		void SetSamplerate(int samplerate, bool keepState = false)
 		{
+			double resampleRatio = keepState ? samplerate / (double)this->samplerate : 0;
 			this->samplerate = samplerate;
 			highPass.SetSamplerate(samplerate);
 			lowPass.SetSamplerate(samplerate);
 			diffuser.SetSamplerate(samplerate);
 
-			for (int i = 0; i < TotalLineCount; i++)
-				lines[i].SetSamplerate(samplerate);
+			for (int i = 0; i < LineBankCount; i++)
+				lines[i].SetSamplerate(GetLateSamplerate());
 
-			ReapplyAllParams();
-			ClearBuffers();
-			UpdateLines();
+			if (resampleRatio <= 0)
+			{
+				AllocateBuffers(); // the new delay buffers start out silent, only the filters are left to clear
+				UpdateSamplerateDependent();
+				ClearState();
+				return;
+			}
+
+			// delay lengths first, so the delays read the carried over history at the positions that match the new rate
+			UpdateSamplerateDependent();
+			std::swap(arena, spareArena); // the current buffers stay alive until their history is carried over
+			AllocateBuffers(resampleRatio);
+		}
+
+		// Sizes the scratch buffers for blocks of up to maxBlockSize samples, Process must not be called with more.
+		// Reallocates and clears the buffers like SetSamplerate, so call it before processing starts.
+		void Prepare(int maxBlockSize)
+		{
+			this->maxBlockSize = maxBlockSize < 1 ? 1 : maxBlockSize;
+			SetSamplerate(samplerate);
+		}
+
+		int GetMaxBlockSize()
+		{
+			return maxBlockSize;
 		}
 
 		void ReapplyAllParams()
@@ -116,6 +226,54 @@ namespace Cloudseed
 				SetParameter(i, paramsScaled[i]);
 		}
 
+		// Takes over every parameter of another channel with the same index, along with everything derived from them,
+		// in time proportional to the number of lines. The same as setting each parameter, but the seed tables,
+		// delay lengths and filter coefficients are copied rather than computed. The buffers, LFO phases
+		// and filter states are kept, except where switching a stage on or off clears it, as SetParameter does.
+		// The samplerate and late decimation must match.
+		void CopySettings(const ReverbChannel& source)
+		{
+			for (int i = 0; i < Parameter::COUNT; i++)
+				paramsScaled[i] = source.paramsScaled[i];
+
+			lowCutEnabled = source.lowCutEnabled;
+			if (lowCutEnabled)
+				highPass.ClearBuffers();
+			highCutEnabled = source.highCutEnabled;
+			if (highCutEnabled)
+				lowPass.ClearBuffers();
+			highPass.CopySettings(source.highPass);
+			lowPass.CopySettings(source.lowPass);
+			inputMix = source.inputMix;
+			dryOut = source.dryOut;
+			earlyOut = source.earlyOut;
+			lineOut = source.lineOut;
+
+			if (source.multitapEnabled != multitapEnabled)
+				multitap.ClearBuffers();
+			multitapEnabled = source.multitapEnabled;
+			multitap.CopySettings(source.multitap);
+			preDelay.CopySettings(source.preDelay);
+
+			if (source.diffuserEnabled != diffuserEnabled)
+				diffuser.ClearBuffers();
+			diffuserEnabled = source.diffuserEnabled;
+			diffuser.CopySettings(source.diffuser);
+
+			lineCount = source.lineCount;
+			for (int i = 0; i < LineBankCount; i++)
+			{
+				if (source.lines[i].DiffuserEnabled != lines[i].DiffuserEnabled)
+					lines[i].ClearDiffuserBuffers();
+				lines[i].CopySettings(source.lines[i]);
+			}
+
+			crossSeed = source.crossSeed;
+			delayLineSeeds = source.delayLineSeeds;
+			delayLineSeed = source.delayLineSeed;
+			postDiffusionSeed = source.postDiffusionSeed;
+		}
+
 		void SetParameter(int para, double scaledValue)
 		{
 			paramsScaled[para] = scaledValue;
@@ -123,7 +281,7 @@ namespace Cloudseed
 			switch (para)
 			{
 			case Parameter::Interpolation:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetInterpolationEnabled(scaledValue >= 0.5);
 				break;
 			case Parameter::LowCutEnabled:
@@ -172,6 +330,7 @@ namespace Cloudseed
 				break;
 			case Parameter::TapPredelay:
 				preDelay.SampleDelay = (int)Ms2Samples(scaledValue);
+				preDelay.UpdateReadIndex();
 				break;
 			case Parameter::TapLength:
 				multitap.SetTapLength((int)Ms2Samples(scaledValue));
@@ -205,23 +364,23 @@ namespace Cloudseed
 
 
 			case Parameter::LateMode:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].TapPostDiffuser = scaledValue >= 0.5;
 				break;
 			case Parameter::LateLineCount:
 				lineCount = (int)scaledValue;
 				break;
 			case Parameter::LateDiffuseEnabled:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 				{
 					auto newVal = scaledValue >= 0.5;
 					if (newVal != lines[i].DiffuserEnabled)
-						lines[i].ClearDiffuserBuffer();
+						lines[i].ClearDiffuserBuffers();
 					lines[i].DiffuserEnabled = newVal;
 				}
 				break;
 			case Parameter::LateDiffuseCount:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetDiffuserStages((int)scaledValue);
 				break;
 			case Parameter::LateLineSize:
@@ -231,8 +390,8 @@ namespace Cloudseed
 				UpdateLines();
 				break;
 			case Parameter::LateDiffuseDelay:
-				for (int i = 0; i < TotalLineCount; i++)
-					lines[i].SetDiffuserDelay((int)Ms2Samples(scaledValue));
+				for (int i = 0; i < LineBankCount; i++)
+					lines[i].SetDiffuserDelay((int)LateMs2Samples(scaledValue));
 				break;
 			case Parameter::LateDiffuseModAmount:
 				UpdateLines();
@@ -244,7 +403,7 @@ namespace Cloudseed
 				UpdateLines();
 				break;
 			case Parameter::LateDiffuseFeedback:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetDiffuserFeedback(scaledValue);
 				break;
 			case Parameter::LateDiffuseModRate:
@@ -253,41 +412,41 @@ namespace Cloudseed
 
 
 			case Parameter::EqLowShelfEnabled:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].LowShelfEnabled = scaledValue >= 0.5;
 				break;
 			case Parameter::EqHighShelfEnabled:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].HighShelfEnabled = scaledValue >= 0.5;
 				break;
 			case Parameter::EqLowpassEnabled:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].CutoffEnabled = scaledValue >= 0.5;
 				break;
 			case Parameter::EqLowFreq:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetLowShelfFrequency(scaledValue);
 				break;
 			case Parameter::EqHighFreq:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetHighShelfFrequency(scaledValue);
 				break;
 			case Parameter::EqCutoff:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetCutoffFrequency(scaledValue);
 				break;
 			case Parameter::EqLowGain:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetLowShelfGain(scaledValue);
 				break;
 			case Parameter::EqHighGain:
-				for (int i = 0; i < TotalLineCount; i++)
+				for (int i = 0; i < LineBankCount; i++)
 					lines[i].SetHighShelfGain(scaledValue);
 				break;
 
 
 			case Parameter::EqCrossSeed:
-				crossSeed = channelLr == ChannelLR::Right ? 0.5 * scaledValue : 1 - 0.5 * scaledValue;
+				crossSeed.Amount = scaledValue;
 				multitap.SetCrossSeed(crossSeed);
 				diffuser.SetCrossSeed(crossSeed);
 				UpdateLines();
@@ -312,90 +471,359 @@ namespace Cloudseed
 			}
 		}
 
-		void Process(float* input, float* output, int bufSize)
+		// When enabled, the channel goes to sleep once its input, early reflections and late lines have all stayed below
+		// thresholdDb for holdMillis, plus the time it takes the pre-delay, taps, diffusers and delay lines to run empty,
+		// see GetDrainMillis.
+		// While asleep only the dry signal is written, at next to no cost. The first block with input above the threshold
+		// wakes the channel up, and processing resumes from the state it was left in.
+		void SetSleepMode(bool enabled, float thresholdDb = -100, float holdMillis = 200)
 		{
-			float tempBuffer[BUFFER_SIZE];
-			float earlyOutBuffer[BUFFER_SIZE];
-			float lineOutBuffer[BUFFER_SIZE];
-			float lineSumBuffer[BUFFER_SIZE];
+			sleepEnabled = enabled;
+			sleepThreshold = Utils::DB2Gainf(thresholdDb);
+			sleepHoldMillis = holdMillis;
+			silentSamples = 0;
+			if (!enabled)
+				sleeping = false;
+		}
 
-			Utils::Copy(tempBuffer, input, bufSize);
+		// Upper bound on the time the last input takes to pass through the pre-delay, taps, diffusers and delay lines.
+		// The input and the late feedback are measured on the way out, so they must have been silent at least this long.
+		double GetDrainMillis()
+		{
+			return paramsScaled[Parameter::TapPredelay]
+				+ (multitapEnabled ? paramsScaled[Parameter::TapLength] : 0)
+				+ (diffuserEnabled ? paramsScaled[Parameter::EarlyDiffuseDelay] * diffuser.Stages : 0)
+				+ 1.5 * paramsScaled[Parameter::LateLineSize]
+				+ (lines[0].DiffuserEnabled ? paramsScaled[Parameter::LateDiffuseDelay] * paramsScaled[Parameter::LateDiffuseCount] : 0);
+		}
+
+		bool IsSleeping()
+		{
+			return sleeping;
+		}
 
+		// When enabled, filtered input below about -90dB is replaced with exact zeros before it reaches the delays.
+		// This used to be the only protection against denormals, ReverbController::SetFlushDenormals covers that now,
+		// so it can be turned off to keep quiet input intact.
+		void SetInputSquelch(bool enabled)
+		{
+			inputSquelch = enabled;
+		}
+
+		bool GetInputSquelch()
+		{
+			return inputSquelch;
+		}
+
+		// Runs the late lines at 1/2 or 1/4 of the samplerate, with half-band filters to decimate their input and
+		// interpolate their output. Everything above about 0.19 times the reduced rate is removed from the late field,
+		// and its output arrives slightly later (45 samples for 2, 135 for 4). Changing the factor clears the buffers.
+		void SetLateDecimation(int factor)
+		{
+			factor = factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+			if (factor == lateDecimation)
+				return;
+
+			lateDecimation = factor;
+			SetSamplerate(samplerate);
+		}
+
+		int GetLateDecimation()
+		{
+			return lateDecimation;
+		}
+
+		// Number of samples between updates of every modulated delay time, 8 by default.
+		// Lower is smoother, higher is cheaper when the modulation is slow.
+		void SetModulationUpdateRate(int samples)
+		{
+			preDelay.SetModulationUpdateRate(samples);
+			diffuser.SetModulationUpdateRate(samples);
+			for (int i = 0; i < LineBankCount; i++)
+				lines[i].SetModulationUpdateRate(samples);
+		}
+
+		// The largest factor for SetLateDecimation that keeps everything the lowpass filters let through,
+		// taken as twice the lowest active cutoff, and never less than 20kHz
+		int GetSuggestedLateDecimation()
+		{
+			float bandwidth = 20000;
+			if (highCutEnabled)
+				bandwidth = std::min(bandwidth, 2 * (float)paramsScaled[Parameter::HighCut]);
+			if (paramsScaled[Parameter::EqLowpassEnabled] >= 0.5)
+				bandwidth = std::min(bandwidth, 2 * (float)paramsScaled[Parameter::EqCutoff]);
+
+			// passband edge of the half-band filters, relative to the rate they decimate from
+			const float passband = 0.19f;
+			if (passband * samplerate / 2 >= bandwidth)
+				return 4;
+			if (passband * samplerate >= bandwidth)
+				return 2;
+			return 1;
+		}
+
+		// bufSize must not be more than the maximum block size, see Prepare. Works in place, input may be the same
+		// buffer as output. Sample i of the output is written to output[i * outputStride], so the output mix
+		// can write straight into an interleaved buffer.
+		void Process(const T* input, T* output, int bufSize, int outputStride = 1)
+		{
+			if (sleeping)
+			{
+				if (Utils::Peak(input, bufSize) < sleepThreshold)
+				{
+					for (int i = 0; i < bufSize; i++)
+						output[i * outputStride] = dryOut * input[i];
+					return;
+				}
+
+				sleeping = false;
+				silentSamples = 0;
+			}
+
+			Timer.Start();
+
+			// the first stage that runs reads the input and writes tempBuffer, the input is copied only if none runs
+			const T* filtered = input;
 			if (lowCutEnabled)
-				highPass.Process(tempBuffer, tempBuffer, bufSize);
+			{
+				highPass.Process(filtered, tempBuffer, bufSize);
+				filtered = tempBuffer;
+			}
 			if (highCutEnabled)
-				lowPass.Process(tempBuffer, tempBuffer, bufSize);
+			{
+				lowPass.Process(filtered, tempBuffer, bufSize);
+				filtered = tempBuffer;
+			}
 
 			// completely zero if no input present
 			// Previously, the very small values were causing some really strange CPU spikes
-			for (int i = 0; i < bufSize; i++)
+			if (inputSquelch)
 			{
-				auto n = tempBuffer[i];
-				if (n * n < 0.000000001)
-					tempBuffer[i] = 0;
+				for (int i = 0; i < bufSize; i++)
+				{
+					auto n = filtered[i];
+					tempBuffer[i] = n * n < 0.000000001 ? 0 : n;
+				}
+			}
+			else if (filtered != tempBuffer)
+			{
+				Utils::Copy(tempBuffer, input, bufSize);
 			}
+			Timer.Lap(Stage::InputFilters);
+
+			// what goes into the pre-delay, input that is only heard once the channel could have gone to sleep
+			T inputPeak = sleepEnabled ? Utils::Peak(tempBuffer, bufSize) : 0;
 
 			preDelay.Process(tempBuffer, tempBuffer, bufSize);
+			Timer.Lap(Stage::PreDelay);
 			if (multitapEnabled)
 				multitap.Process(tempBuffer, tempBuffer, bufSize);
+			Timer.Lap(Stage::Multitap);
 			if (diffuserEnabled)
 				diffuser.Process(tempBuffer, tempBuffer, bufSize);
-			
-			Utils::Copy(earlyOutBuffer, tempBuffer, bufSize);
-			Utils::ZeroBuffer(lineSumBuffer, bufSize);
-			for (int i = 0; i < lineCount; i++)
+			Timer.Lap(Stage::Diffuser);
+
+			// tempBuffer now holds the early output, the late lines only read it
+			T* earlyOutBuffer = tempBuffer;
+			T* lateInput = tempBuffer;
+			int lateSize = bufSize;
+			if (lateDecimation > 1)
 			{
-				lines[i].Process(tempBuffer, lineOutBuffer, bufSize);
-				Utils::Mix(lineSumBuffer, lineOutBuffer, 1.0f, bufSize);
+				lateSize = lateDecimators[0].Process(tempBuffer, lateInputBuffer, bufSize);
+				if (lateDecimation > 2)
+					lateSize = lateDecimators[1].Process(lateInputBuffer, lateInputBuffer, lateSize);
+				lateInput = lateInputBuffer;
+			}
+
+			Utils::ZeroBuffer(lineSumBuffer, lateSize);
+			for (int i = 0; i < LineBankCount; i++)
+			{
+				int activeLanes = lineCount - i * LineLanes;
+				if (activeLanes <= 0)
+					break;
+				if (activeLanes > LineLanes)
+					activeLanes = LineLanes;
+
+				lines[i].Process(lateInput, lineSumBuffer, lateSize, activeLanes);
+				Timer.Lap(Stage::LateBank + i);
 			}
 
 			auto perLineGain = GetPerLineGain();
-			Utils::Gain(lineSumBuffer, perLineGain, bufSize);
+			Utils::Gain(lineSumBuffer, perLineGain, lateSize);
+			if (lateDecimation > 1)
+				InterpolateLate(lineSumBuffer, lateSize, bufSize);
 
-			for (int i = 0; i < bufSize; i++)
+			if (outputStride == 1)
+			{
+				for (int i = 0; i < bufSize; i++)
+				{
+					output[i] = dryOut * input[i]
+						+ earlyOut * earlyOutBuffer[i]
+						+ lineOut * lineSumBuffer[i];
+				}
+			}
+			else
 			{
-				output[i] = dryOut * input[i]
-					+ earlyOut * earlyOutBuffer[i]
-					+ lineOut * lineSumBuffer[i];
+				for (int i = 0; i < bufSize; i++)
+				{
+					output[i * outputStride] = dryOut * input[i]
+						+ earlyOut * earlyOutBuffer[i]
+						+ lineOut * lineSumBuffer[i];
+				}
 			}
+			Timer.Lap(Stage::OutputMix);
+
+			if (sleepEnabled)
+				UpdateSleepState(inputPeak, earlyOutBuffer, bufSize);
 		}
 
 		void ClearBuffers()
 		{
-			lowPass.ClearBuffers();
-			highPass.ClearBuffers();
 			preDelay.ClearBuffers();
 			multitap.ClearBuffers();
 			diffuser.ClearBuffers();
-			for (int i = 0; i < TotalLineCount; i++)
+			for (int i = 0; i < LineBankCount; i++)
 				lines[i].ClearBuffers();
+			ClearState();
+			clearPosition = 0;
+		}
+
+		// Does the same as ClearBuffers in steps: every call zeroes up to maxBytes more of the memory, the channel's
+		// delay buffers and scratch all live in one arena. Returns true once the channel is clear, the next call
+		// then starts over. Process must not be called while a clear is under way.
+		bool ClearBuffersStep(size_t maxBytes)
+		{
+			auto used = arena.GetUsed();
+			auto bytes = std::min(maxBytes, used - clearPosition);
+			arena.Zero(clearPosition, bytes);
+			clearPosition += bytes;
+			if (clearPosition < used)
+				return false;
+
+			ClearState();
+			clearPosition = 0;
+			return true;
+		}
+
+		// The runtime state of every stage: the live part of each delay's history, the read positions, LFO phases and
+		// filter states, and the late output not yet played. The parameters are not included, see ReverbController::SaveState.
+		void SaveState(StateWriter& writer)
+		{
+			writer.Write((int)LineLanes);
+			highPass.SaveState(writer);
+			lowPass.SaveState(writer);
+			preDelay.SaveState(writer);
+			multitap.SaveState(writer);
+			diffuser.SaveState(writer);
+			for (int i = 0; i < LineBankCount; i++)
+				lines[i].SaveState(writer);
+			for (int i = 0; i < 2; i++)
+			{
+				lateDecimators[i].SaveState(writer);
+				lateInterpolators[i].SaveState(writer);
+			}
+			writer.Write(lateOutputCount);
+			writer.Write(lateOutput, lateOutputCount);
+			writer.Write(silentSamples);
+			writer.Write(sleeping);
+		}
+
+		// Restores what SaveState wrote. The channel must be cleared, and set to the parameters, samplerate and
+		// late decimation of the channel that was saved.
+		void LoadState(StateReader& reader)
+		{
+			if (reader.Read<int>() != LineLanes) // built with another LATE_LINE_LANES
+			{
+				reader.Fail();
+				return;
+			}
+
+			highPass.LoadState(reader);
+			lowPass.LoadState(reader);
+			preDelay.LoadState(reader);
+			multitap.LoadState(reader);
+			diffuser.LoadState(reader);
+			for (int i = 0; i < LineBankCount; i++)
+				lines[i].LoadState(reader);
+			for (int i = 0; i < 2; i++)
+			{
+				lateDecimators[i].LoadState(reader);
+				lateInterpolators[i].LoadState(reader);
+			}
+
+			int count = reader.Read<int>();
+			if (count < 0 || count >= lateDecimation)
+			{
+				reader.Fail();
+				return;
+			}
+			lateOutputCount = count;
+			reader.Read(lateOutput, count);
+			silentSamples = reader.Read<int>();
+			sleeping = reader.Read<bool>();
 		}
 
 
 	private:
-		float GetPerLineGain()
+		// Everything but the delay memory: the filters, the pending feedback, the half-band filters and the late output not yet played
+		void ClearState()
+		{
+			silentSamples = 0;
+			lowPass.ClearBuffers();
+			highPass.ClearBuffers();
+			for (int i = 0; i < LineBankCount; i++)
+				lines[i].ClearState();
+			for (int i = 0; i < 2; i++)
+			{
+				lateDecimators[i].ClearBuffers();
+				lateInterpolators[i].ClearBuffers();
+			}
+
+			// the interpolated output runs lateDecimation - 1 samples behind, so every block can be filled
+			lateOutputCount = lateDecimation - 1;
+			if (lateOutput != nullptr)
+				Utils::ZeroBuffer(lateOutput, lateOutputCount);
+		}
+
+		T GetPerLineGain()
 		{
 			return 1.0 / std::sqrt(lineCount);
 		}
 
+		// Every parameter that is converted to samples or depends on the samplerate otherwise, the late line settings
+		// all go through UpdateLines
+		void UpdateSamplerateDependent()
+		{
+			const int parameters[] =
+			{
+				Parameter::LowCut, Parameter::HighCut, Parameter::TapPredelay, Parameter::TapLength,
+				Parameter::EarlyDiffuseDelay, Parameter::EarlyDiffuseModAmount, Parameter::LateDiffuseDelay,
+				Parameter::EqLowFreq, Parameter::EqHighFreq, Parameter::EqCutoff
+			};
+
+			for (auto para : parameters)
+				SetParameter(para, paramsScaled[para]);
+			UpdateLines();
+		}
+
 		void UpdateLines()
 		{
-			auto lineDelaySamples = (int)Ms2Samples(paramsScaled[Parameter::LateLineSize]);
+			auto lineDelaySamples = (int)LateMs2Samples(paramsScaled[Parameter::LateLineSize]);
 			auto lineDecayMillis = paramsScaled[Parameter::LateLineDecay] * 1000;
-			auto lineDecaySamples = Ms2Samples(lineDecayMillis);
+			auto lineDecaySamples = LateMs2Samples(lineDecayMillis);
 
-			auto lineModAmount = Ms2Samples(paramsScaled[Parameter::LateLineModAmount]);
+			auto lineModAmount = LateMs2Samples(paramsScaled[Parameter::LateLineModAmount]);
 			auto lineModRate = paramsScaled[Parameter::LateLineModRate];
 
-			auto lateDiffusionModAmount = Ms2Samples(paramsScaled[Parameter::LateDiffuseModAmount]);
+			auto lateDiffusionModAmount = LateMs2Samples(paramsScaled[Parameter::LateDiffuseModAmount]);
 			auto lateDiffusionModRate = paramsScaled[Parameter::LateDiffuseModRate];
 
-			auto delayLineSeeds = RandomBuffer::Generate(delayLineSeed, TotalLineCount * 3, crossSeed);
+			delayLineSeeds.Generate(delayLineSeed, TotalLineCount * 3, crossSeed);
 
 			for (int i = 0; i < TotalLineCount; i++)
 			{
 				auto modAmount = lineModAmount * (0.7 + 0.3 * delayLineSeeds[i]);
-				auto modRate = lineModRate * (0.7 + 0.3 * delayLineSeeds[TotalLineCount + i]) / samplerate;
+				auto modRate = lineModRate * (0.7 + 0.3 * delayLineSeeds[TotalLineCount + i]) / GetLateSamplerate();
 
 				auto delaySamples = (0.5 + 1.0 * delayLineSeeds[TotalLineCount * 2 + i]) * lineDelaySamples;
 				if (delaySamples < modAmount + 2) // when the delay is set really short, and the modulation is very high
@@ -404,19 +832,127 @@ namespace Cloudseed
 				auto dbAfter1Iteration = delaySamples / lineDecaySamples * (-60); // lineDecay is the time it takes to reach T60
 				auto gainAfter1Iteration = Utils::DB2Gainf(dbAfter1Iteration);
 
-				lines[i].SetDelay((int)delaySamples);
-				lines[i].SetFeedback(gainAfter1Iteration);
-				lines[i].SetLineModAmount(modAmount);
-				lines[i].SetLineModRate(modRate);
-				lines[i].SetDiffuserModAmount(lateDiffusionModAmount);
-				lines[i].SetDiffuserModRate(lateDiffusionModRate);
+				auto& bank = lines[i / LineLanes];
+				auto lane = i % LineLanes;
+				bank.SetDelay(lane, (int)delaySamples);
+				bank.SetFeedback(lane, gainAfter1Iteration);
+				bank.SetLineModAmount(lane, modAmount);
+				bank.SetLineModRate(lane, modRate);
+				bank.SetDiffuserModAmount(lane, lateDiffusionModAmount);
+				bank.SetDiffuserModRate(lane, lateDiffusionModRate);
+			}
+		}
+
+		// Sizes every delay buffer for the longest delay the parameter ranges allow at the current samplerate,
+		// and carves them all, along with the block scratch buffers, out of a single per-channel block.
+		// With a resampleRatio above 0, the history in the current buffers is carried over, see ModulatedDelay::SetBuffer
+		void AllocateBuffers(double resampleRatio = 0)
+		{
+			if (settingsOnly)
+				return;
+
+			auto preDelaySize = ModulatedDelay<T, TStorage>::GetBufferSize(Ms2Samples(ScaleParam(1.0, Parameter::TapPredelay)), 0, maxBlockSize);
+			auto multitapSize = MultitapDelay<T, TStorage>::GetBufferSize(Ms2Samples(ScaleParam(1.0, Parameter::TapLength)), maxBlockSize);
+			auto earlyAllpassSize = ModulatedAllpass<T, TStorage>::GetBufferSize(
+				Ms2Samples(ScaleParam(1.0, Parameter::EarlyDiffuseDelay)),
+				Ms2Samples(ScaleParam(1.0, Parameter::EarlyDiffuseModAmount)) * 1.15f); // per-stage mod spread is 0.85 ... 1.15
+			auto lineSize = ModulatedDelay<T, TStorage>::GetBufferSize(
+				Ms2Samples(ScaleParam(1.0, Parameter::LateLineSize)) * 1.5f, // per-line delay spread is 0.5 ... 1.5
+				Ms2Samples(ScaleParam(1.0, Parameter::LateLineModAmount)));
+			auto lateAllpassSize = ModulatedAllpass<T, TStorage>::GetBufferSize(
+				Ms2Samples(ScaleParam(1.0, Parameter::LateDiffuseDelay)),
+				Ms2Samples(ScaleParam(1.0, Parameter::LateDiffuseModAmount)) * 1.15f);
+
+			auto earlyDiffuserSize = AllpassDiffuser<T, TStorage>::MaxStageCount * earlyAllpassSize;
+			auto lineDelaySize = lineSize * LineLanes;
+			auto lineDiffuserSize = LineBank::MaxStageCount * lateAllpassSize * LineLanes;
+			auto lineWorkspaceSize = LineBank::GetWorkspaceSize(maxBlockSize);
+			auto lateOutputSize = maxBlockSize + 4;
+
+			auto total = BufferArena::Padded<TStorage>(preDelaySize)
+				+ BufferArena::Padded<TStorage>(multitapSize)
+				+ BufferArena::Padded<TStorage>(earlyDiffuserSize)
+				+ LineBankCount * (BufferArena::Padded<TStorage>(lineDelaySize) + BufferArena::Padded<TStorage>(lineDiffuserSize) + BufferArena::Padded<T>(lineWorkspaceSize))
+				+ 4 * BufferArena::Padded<T>(maxBlockSize)
+				+ BufferArena::Padded<T>(lateOutputSize);
+			arena.Reset(total);
+			clearPosition = 0;
+
+			preDelay.SetBuffer(arena.Allocate<TStorage>(preDelaySize), preDelaySize, resampleRatio);
+			multitap.SetBuffer(arena.Allocate<TStorage>(multitapSize), multitapSize, maxBlockSize, resampleRatio);
+			diffuser.SetBuffer(arena.Allocate<TStorage>(earlyDiffuserSize), earlyAllpassSize, resampleRatio);
+			for (int i = 0; i < LineBankCount; i++)
+			{
+				lines[i].SetDelayBuffer(arena.Allocate<TStorage>(lineDelaySize), lineSize, resampleRatio);
+				lines[i].SetAllpassBuffer(arena.Allocate<TStorage>(lineDiffuserSize), lateAllpassSize, resampleRatio);
+				lines[i].SetWorkspace(arena.Allocate<T>(lineWorkspaceSize), maxBlockSize, resampleRatio > 0);
+			}
+
+			auto previousLateOutput = lateOutput;
+			tempBuffer = arena.Allocate<T>(maxBlockSize);
+			lineSumBuffer = arena.Allocate<T>(maxBlockSize);
+			lateInputBuffer = arena.Allocate<T>(maxBlockSize);
+			halfRateBuffer = arena.Allocate<T>(maxBlockSize);
+			lateOutput = arena.Allocate<T>(lateOutputSize);
+			if (resampleRatio > 0) // the few interpolated late samples not yet played, they are too short to be worth resampling
+				Utils::Copy(lateOutput, previousLateOutput, lateOutputCount);
+		}
+
+		// inputPeak is the peak of the filtered input, early the block that fed the late lines
+		void UpdateSleepState(T inputPeak, const T* early, int bufSize)
+		{
+			auto peak = std::max(inputPeak, Utils::Peak(early, bufSize));
+			for (int i = 0; i < LineBankCount && peak < sleepThreshold; i++)
+			{
+				int activeLanes = lineCount - i * LineLanes;
+				if (activeLanes <= 0)
+					break;
+				if (activeLanes > LineLanes)
+					activeLanes = LineLanes;
+				peak = std::max(peak, lines[i].GetFeedbackPeak(activeLanes));
+			}
+
+			if (peak >= sleepThreshold)
+			{
+				silentSamples = 0;
+				return;
 			}
+
+			silentSamples += bufSize;
+			if (silentSamples >= Ms2Samples(GetDrainMillis() + sleepHoldMillis))
+				sleeping = true;
 		}
 
 		void UpdatePostDiffusion()
 		{
 			for (int i = 0; i < TotalLineCount; i++)
-				lines[i].SetDiffuserSeed((postDiffusionSeed) * (i + 1), crossSeed);
+				lines[i / LineLanes].SetDiffuserSeed(i % LineLanes, (postDiffusionSeed) * (i + 1), crossSeed);
+		}
+
+		// Brings the late output back to the full rate, and writes the next bufSize samples of it to lineSum
+		void InterpolateLate(T* lineSum, int lateSize, int bufSize)
+		{
+			T* dest = &lateOutput[lateOutputCount];
+			if (lateDecimation > 2)
+			{
+				lateInterpolators[1].Process(lineSum, halfRateBuffer, lateSize);
+				lateInterpolators[0].Process(halfRateBuffer, dest, lateSize * 2);
+			}
+			else
+			{
+				lateInterpolators[0].Process(lineSum, dest, lateSize);
+			}
+			lateOutputCount += lateSize * lateDecimation;
+
+			Utils::Copy(lineSum, lateOutput, bufSize);
+			lateOutputCount -= bufSize;
+			for (int i = 0; i < lateOutputCount; i++)
+				lateOutput[i] = lateOutput[bufSize + i];
+		}
+
+		int GetLateSamplerate()
+		{
+			return samplerate / lateDecimation;
 		}
 
 		float Ms2Samples(float value)
@@ -424,5 +960,10 @@ namespace Cloudseed
 			return value / 1000.0f * samplerate;
 		}
 
+		float LateMs2Samples(float value)
+		{
+			return value / 1000.0f * GetLateSamplerate();
+		}
+
 	};
 }
@@ -23,29 +23,91 @@ THE SOFTWARE.
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
 #include "../Parameters.h"
 #include "ReverbChannel.h"
+#include "ReverbPreset.h"
 #include "AllpassDiffuser.h"
 #include "MultitapDelay.h"
 #include "Utils.h"
+#include "WorkerThread.h"
+#include "ParameterQueue.h"
+#include "PartitionedConvolver.h"
+#include "DenormalGuard.h"
+#include "BufferArena.h"
+#include "StereoView.h"
+#include "StateStream.h"
 
 namespace Cloudseed
 {
-	class ReverbController
+	// T is the sample type the reverb computes in, float for realtime or double for offline renders. TStorage is the
+	// type the delay buffers store their history as, see SampleStorage. ReverbController is the float version.
+	template<typename T, typename TStorage = T>
+	class BasicReverbController
 	{
 	private:
+		typedef BasicStereoView<T> View;
+
 		int samplerate;
+		int maxBlockSize;
+		uint64_t seed;
+
+		// Scratch for one block, see Prepare
+		BufferArena workspace;
+		T* leftChannelIn;
+		T* rightChannelIn;
+		T* silence;
+		T* tail;
 
-		ReverbChannel channelL;
-		ReverbChannel channelR;
+		ReverbChannel<T, TStorage> channelL;
+		ReverbChannel<T, TStorage> channelR;
 		double parameters[(int)Parameter::COUNT] = {0};
 
+		// Parameter changes posted by the control thread, applied by Process at their sample position
+		ParameterQueue parameterQueue;
+		std::atomic<uint64_t> samplePosition;
+
+		// Optional worker that processes the right channel in parallel with the left
+		std::unique_ptr<WorkerThread> worker;
+		T* rightJobInput;
+		T* rightJobOutput;
+		int rightJobOutputStride;
+		int rightJobBufSize;
+
+		// Convolution fast path, see CaptureImpulse
+		PartitionedConvolver<T> convolverL;
+		PartitionedConvolver<T> convolverR;
+		bool convolutionActive;
+		int convolutionTail; // samples the convolvers keep ringing after falling back to the channels
+		bool clearingRight; // ClearBuffersStep is done with the left channel
+		int channelTail; // samples the channels keep ringing after switching to the convolvers
+
+		bool flushDenormals;
+
 	public:
-		ReverbController(int samplerate) :
+		// Instances with the same seed and parameters give the same output for the same input, see SetSeed
+		BasicReverbController(int samplerate, uint64_t seed = 0) :
 			channelL(samplerate, ChannelLR::Left),
-			channelR(samplerate, ChannelLR::Right)
+			channelR(samplerate, ChannelLR::Right),
+			samplePosition(0)
 		{
 			this->samplerate = samplerate;
+			SetSeed(seed);
+			maxBlockSize = channelL.GetMaxBlockSize();
+			AllocateWorkspace();
+			rightJobInput = nullptr;
+			rightJobOutput = nullptr;
+			rightJobOutputStride = 1;
+			rightJobBufSize = 0;
+			convolutionActive = false;
+			convolutionTail = 0;
+			clearingRight = false;
+			channelTail = 0;
+			flushDenormals = true;
 		}
 
 		int GetSamplerate()
@@ -53,11 +115,49 @@ namespace Cloudseed
 			return samplerate;
 		}
 
-		void SetSamplerate(int samplerate)
+		// Sets the starting phases of all the modulation. The output is fully determined by the seed, the parameters and
+		// the input, so renders can be reproduced and cached. The left and right channel draw different phases from
+		// the same seed. Restarts the modulation, so call it before processing, or along with ClearBuffers.
+		void SetSeed(uint64_t seed)
+		{
+			this->seed = seed;
+			channelL.SetSeed(seed);
+			channelR.SetSeed(seed);
+		}
+
+		uint64_t GetSeed()
+		{
+			return seed;
+		}
+
+		// Only recomputes what depends on the samplerate. With keepState, the reverb tail is resampled to the new rate
+		// and carries on, rather than starting again from silence, see ReverbChannel::SetSamplerate.
+		// The convolution fast path is turned off either way, its impulse was captured at the old rate.
+		void SetSamplerate(int samplerate, bool keepState = false)
 		{
 			this->samplerate = samplerate;
-			channelL.SetSamplerate(samplerate);
-			channelR.SetSamplerate(samplerate);
+			channelL.SetSamplerate(samplerate, keepState);
+			channelR.SetSamplerate(samplerate, keepState);
+			convolutionActive = false;
+			convolutionTail = 0;
+			channelTail = 0;
+		}
+
+		// Sizes every scratch buffer for blocks of up to maxBlockSize samples. Process still takes any block size, it
+		// splits longer blocks into pieces of maxBlockSize. Until this is called, the maximum is BUFFER_SIZE.
+		// Reallocates and clears the channels, so call it from a non-realtime thread before processing starts.
+		void Prepare(int maxBlockSize)
+		{
+			this->maxBlockSize = maxBlockSize < 1 ? 1 : maxBlockSize;
+			AllocateWorkspace();
+			channelL.Prepare(this->maxBlockSize);
+			channelR.Prepare(this->maxBlockSize);
+			channelTail = 0;
+		}
+
+		int GetMaxBlockSize()
+		{
+			return maxBlockSize;
 		}
 
 		int GetParameterCount()
@@ -70,57 +170,529 @@ namespace Cloudseed
 			return parameters;
 		}
 
+		// Applies the change immediately. Not safe to call while Process is running on another thread,
+		// use PostParameter for changes coming from a control or UI thread.
 		void SetParameter(int paramId, double value)
 		{
+			if (convolutionActive && value != parameters[paramId])
+				StopConvolution();
+
 			parameters[paramId] = value;
 			auto scaled = ScaleParam(value, paramId);
 			channelL.SetParameter(paramId, scaled);
 			channelR.SetParameter(paramId, scaled);
 		}
 
+		// Switches to a compiled program, see BasicReverbPreset. The result is the same as setting every parameter,
+		// but the derived state is copied rather than computed. Falls back to setting each parameter when the preset
+		// was compiled for another samplerate, late decimation or channel count.
+		void ApplyPreset(const BasicReverbPreset<T, TStorage>& preset)
+		{
+			if (preset.GetSamplerate() != samplerate || preset.GetLateDecimation() != GetLateDecimation() || preset.GetChannelCount() != 2)
+			{
+				for (int i = 0; i < Parameter::COUNT; i++)
+					SetParameter(i, preset.GetParameter(i));
+				return;
+			}
+
+			bool changed = false;
+			for (int i = 0; i < Parameter::COUNT; i++)
+			{
+				changed = changed || preset.GetParameter(i) != parameters[i];
+				parameters[i] = preset.GetParameter(i);
+			}
+
+			if (convolutionActive && changed)
+				StopConvolution();
+			channelL.CopySettings(preset.GetChannel(0));
+			channelR.CopySettings(preset.GetChannel(1));
+		}
+
+		// Queues a parameter change to be applied by the audio thread, exactly at sampleTime (see GetSamplePosition).
+		// Changes whose time has already passed are applied at the start of the next block. Safe to call from one
+		// thread while Process runs on another. Returns false if the queue is full and the change was dropped.
+		bool PostParameter(int paramId, double value, uint64_t sampleTime = 0)
+		{
+			ParameterEvent ev;
+			ev.ParamId = paramId;
+			ev.Value = value;
+			ev.SampleTime = sampleTime;
+			return parameterQueue.Push(ev);
+		}
+
+		// Number of samples processed so far, the time base for PostParameter
+		uint64_t GetSamplePosition()
+		{
+			return samplePosition.load(std::memory_order_relaxed);
+		}
+
+		StageTimer& GetStageTimer(ChannelLR channel)
+		{
+			return channel == ChannelLR::Left ? channelL.Timer : channelR.Timer;
+		}
+
+		// When enabled, the right channel is processed on a dedicated worker thread while the calling thread
+		// processes the left channel. Creates or destroys the thread, so call this from a non-realtime thread,
+		// never concurrently with Process. cpuCore pins the worker to a core, -1 leaves it to the OS.
+		void SetParallelProcessing(bool enabled, int cpuCore = -1)
+		{
+			if (enabled && !worker)
+				worker.reset(new WorkerThread(cpuCore));
+			else if (!enabled)
+				worker.reset();
+		}
+
+		bool GetParallelProcessing()
+		{
+			return worker != nullptr;
+		}
+
+		// Lets each channel stop processing once its tail has decayed below thresholdDb and the input is silent,
+		// see ReverbChannel::SetSleepMode
+		void SetSleepMode(bool enabled, float thresholdDb = -100, float holdMillis = 200)
+		{
+			channelL.SetSleepMode(enabled, thresholdDb, holdMillis);
+			channelR.SetSleepMode(enabled, thresholdDb, holdMillis);
+		}
+
+		bool IsSleeping()
+		{
+			return channelL.IsSleeping() && channelR.IsSleeping();
+		}
+
+		// Longest time input can take to pass through either channel, see ReverbChannel::GetDrainMillis
+		double GetDrainMillis()
+		{
+			return std::max(channelL.GetDrainMillis(), channelR.GetDrainMillis());
+		}
+
+		// When enabled (the default), denormals are flushed to zero while Process runs, on the calling thread
+		// and on the parallel worker, see DenormalGuard. The thread's previous floating point mode is restored
+		// before Process returns.
+		void SetFlushDenormals(bool enabled)
+		{
+			flushDenormals = enabled;
+		}
+
+		bool GetFlushDenormals()
+		{
+			return flushDenormals;
+		}
+
+		// Replaces near silent input with exact zeros, see ReverbChannel::SetInputSquelch
+		void SetInputSquelch(bool enabled)
+		{
+			channelL.SetInputSquelch(enabled);
+			channelR.SetInputSquelch(enabled);
+		}
+
+		// Runs the late lines of both channels at 1/2 or 1/4 of the samplerate, see ReverbChannel::SetLateDecimation.
+		// Clears the buffers, so call it when loading a preset rather than while audio is playing.
+		void SetLateDecimation(int factor)
+		{
+			StopConvolution();
+			channelL.SetLateDecimation(factor);
+			channelR.SetLateDecimation(factor);
+		}
+
+		int GetLateDecimation()
+		{
+			return channelL.GetLateDecimation();
+		}
+
+		// The largest decimation that keeps everything the current filter settings let through
+		int GetSuggestedLateDecimation()
+		{
+			return channelL.GetSuggestedLateDecimation();
+		}
+
+		// Number of samples between updates of the modulated delay times, see ReverbChannel::SetModulationUpdateRate
+		void SetModulationUpdateRate(int samples)
+		{
+			channelL.SetModulationUpdateRate(samples);
+			channelR.SetModulationUpdateRate(samples);
+		}
+
+		// True when none of the modulation is active, so the reverb is linear and time invariant
+		// and can be replaced by its impulse response
+		bool IsTimeInvariant()
+		{
+			auto earlyDiffuse = ScaleParam(parameters[Parameter::EarlyDiffuseEnabled], Parameter::EarlyDiffuseEnabled) >= 0.5;
+			auto earlyMod = ScaleParam(parameters[Parameter::EarlyDiffuseModAmount], Parameter::EarlyDiffuseModAmount) > 0.5;
+			auto lateDiffuse = ScaleParam(parameters[Parameter::LateDiffuseEnabled], Parameter::LateDiffuseEnabled) >= 0.5;
+			auto lateDiffuseMod = parameters[Parameter::LateDiffuseModAmount] > 0;
+			auto lineMod = parameters[Parameter::LateLineModAmount] > 0;
+			return !(earlyDiffuse && earlyMod) && !(lateDiffuse && lateDiffuseMod) && !lineMod;
+		}
+
+		// Renders the stereo impulse response of the current parameters and switches Process over to convolving with it.
+		// The response is rendered in captureBlockSize blocks, use the host block size to match the channels exactly,
+		// and is cut off once it stays below thresholdDb, or after maxSeconds. maxFftBlockSize is the longest
+		// FFT block of the convolvers, see PartitionedConvolver.
+		// Returns false, and leaves the channels running, if any modulation is active.
+		// Allocates and renders several seconds of audio, so call this from a non-realtime thread, never concurrently
+		// with Process. Any parameter change afterwards falls back to the channels until the next capture.
+		bool CaptureImpulse(int maxFftBlockSize = 4096, int captureBlockSize = 256, float thresholdDb = -90, float maxSeconds = 30)
+		{
+			if (!IsTimeInvariant())
+				return false;
+
+			DenormalGuard denormalGuard(flushDenormals);
+			std::vector<T> impulseL, impulseR;
+			CaptureChannel(ChannelLR::Left, captureBlockSize, thresholdDb, maxSeconds, impulseL);
+			CaptureChannel(ChannelLR::Right, captureBlockSize, thresholdDb, maxSeconds, impulseR);
+			convolverL.SetImpulse(impulseL.data(), (int)impulseL.size(), maxFftBlockSize);
+			convolverR.SetImpulse(impulseR.data(), (int)impulseR.size(), maxFftBlockSize);
+
+			// whatever the channels were still playing rings out underneath the convolution
+			channelTail = std::max(convolverL.GetLength(), convolverR.GetLength());
+			convolutionTail = 0;
+			convolutionActive = true;
+			return true;
+		}
+
+		bool GetConvolutionActive()
+		{
+			return convolutionActive;
+		}
+
+		// Falls back to the channels, the convolution tail rings out underneath them
+		void StopConvolution()
+		{
+			if (!convolutionActive)
+				return;
+
+			convolutionActive = false;
+			convolutionTail = std::max(convolverL.GetLength(), convolverR.GetLength());
+			channelTail = 0;
+		}
+
 		void ClearBuffers()
 		{
 			channelL.ClearBuffers();
 			channelR.ClearBuffers();
+			convolverL.ClearBuffers();
+			convolverR.ClearBuffers();
+			convolutionTail = 0;
+			channelTail = 0;
+			clearingRight = false;
+		}
+
+		// Clears the channels like ClearBuffers, a little at a time, so an instance that is not processing can be
+		// cleared from the audio thread without a spike in the cost of a block. Every call zeroes up to maxBytes of
+		// delay memory, and it returns true once both channels are clear. A convolution in use is stopped without
+		// a tail, rather than clearing the convolvers, CaptureImpulse starts them again from silence.
+		// Process must not be called until the clear is complete.
+		bool ClearBuffersStep(size_t maxBytes)
+		{
+			if (!clearingRight)
+			{
+				clearingRight = channelL.ClearBuffersStep(maxBytes);
+				return false;
+			}
+
+			if (!channelR.ClearBuffersStep(maxBytes))
+				return false;
+
+			clearingRight = false;
+			convolutionActive = false;
+			convolutionTail = 0;
+			channelTail = 0;
+			return true;
+		}
+
+		// Appends a snapshot of the complete runtime state to data: the parameters, samplerate and late decimation,
+		// the history, read positions, LFO phases and filter states of both channels, and the convolvers while the
+		// convolution path is in use. Each delay only stores the part of its history that can still be read at its
+		// current settings. Other settings, such as sleep mode, and changes still waiting in the PostParameter
+		// queue are not included. Values are stored as they are in memory, so a snapshot moves between processes
+		// on the same kind of machine, built with the same LATE_LINE_LANES. Not safe to call while Process is running.
+		void SaveState(std::vector<uint8_t>& data)
+		{
+			StateWriter writer(data);
+			StateHeader header;
+			header.Version = StateHeader::CurrentVersion;
+			header.SampleType = StateTypeId<T>::Value;
+			header.StorageType = StateTypeId<TStorage>::Value;
+			header.ChannelCount = 2;
+			header.Samplerate = samplerate;
+			header.LateDecimation = GetLateDecimation();
+			header.Write(writer);
+
+			writer.Write((int)Parameter::COUNT);
+			writer.Write(parameters, Parameter::COUNT);
+			writer.Write((uint64_t)samplePosition.load(std::memory_order_relaxed));
+			channelL.SaveState(writer);
+			channelR.SaveState(writer);
+
+			bool convolverState = convolutionActive || convolutionTail > 0;
+			writer.Write(convolutionActive);
+			writer.Write(convolutionTail);
+			writer.Write(channelTail);
+			writer.Write(convolverState);
+			if (convolverState)
+			{
+				convolverL.SaveState(writer);
+				convolverR.SaveState(writer);
+			}
+		}
+
+		// Restores a snapshot taken by SaveState, in one pass over the data: sets the samplerate, late decimation and
+		// parameters it was saved with, clears the channels and loads the saved state into them. Processing then
+		// carries on exactly where the saved instance left off. Allocates when the samplerate or late decimation
+		// change, or convolvers are restored, so call it from a non-realtime thread, never concurrently with Process.
+		// Returns false and leaves the instance as it was if the data is not a snapshot of a ReverbController
+		// with these sample types, or is from a later version. Returns false and clears the instance if the
+		// data is cut short or doesn't fit this instance.
+		bool RestoreState(const uint8_t* data, size_t size)
+		{
+			StateReader reader(data, size);
+			StateHeader header;
+			if (!header.Read(reader) || header.SampleType != StateTypeId<T>::Value || header.StorageType != StateTypeId<TStorage>::Value
+				|| header.ChannelCount != 2 || header.Samplerate <= 0 || reader.Read<int>() != Parameter::COUNT)
+				return false;
+			if (header.LateDecimation != 1 && header.LateDecimation != 2 && header.LateDecimation != 4)
+				return false;
+
+			double values[Parameter::COUNT];
+			reader.Read(values, Parameter::COUNT);
+			if (reader.Failed())
+				return false;
+
+			if (header.Samplerate != samplerate)
+				SetSamplerate(header.Samplerate);
+			if (header.LateDecimation != GetLateDecimation())
+				SetLateDecimation(header.LateDecimation);
+			for (int i = 0; i < Parameter::COUNT; i++)
+				SetParameter(i, values[i]);
+			ClearBuffers();
+
+			samplePosition.store(reader.Read<uint64_t>(), std::memory_order_relaxed);
+			channelL.LoadState(reader);
+			channelR.LoadState(reader);
+
+			bool active = reader.Read<bool>();
+			int activeConvolutionTail = reader.Read<int>();
+			int activeChannelTail = reader.Read<int>();
+			if (reader.Read<bool>())
+			{
+				convolverL.LoadState(reader);
+				convolverR.LoadState(reader);
+			}
+
+			if (reader.Failed())
+			{
+				ClearBuffers();
+				convolutionActive = false;
+				return false;
+			}
+
+			convolutionActive = active;
+			convolutionTail = activeConvolutionTail;
+			channelTail = activeChannelTail;
+			return true;
 		}
 
-		void Process(float* inL, float* inR, float* outL, float* outR, int bufSize)
+		// Renders straight into outL and outR. The output may be the same memory as the input (outL == inL,
+		// outR == inR, or even swapped), see also ProcessInPlace.
+		void Process(T* inL, T* inR, T* outL, T* outR, int bufSize)
 		{
-			float outLTemp[BUFFER_SIZE];
-			float outRTemp[BUFFER_SIZE];
+			Process(View::Planar(inL, inR), View::Planar(outL, outR), bufSize);
+		}
+
+		// Processes the block in place, the output overwrites the input
+		void ProcessInPlace(T* left, T* right, int bufSize)
+		{
+			Process(left, right, left, right, bufSize);
+		}
+
+		// Interleaved frames of channelCount samples, the stereo pair being the first two channels of each frame.
+		// Input and output may be the same buffer.
+		void ProcessInterleaved(T* input, T* output, int frames, int channelCount = 2)
+		{
+			Process(View::Interleaved(input, channelCount), View::Interleaved(output, channelCount), frames);
+		}
+
+		// Any planar, interleaved or strided layout. The input is deinterleaved by the input mix and the output
+		// interleaved by the output mix of each channel, there is no separate pass over the buffers.
+		// The output may be the same memory as the input, laid out the same way.
+		void Process(const View& input, const View& output, int bufSize)
+		{
+			View in = input;
+			View out = output;
+			DenormalGuard denormalGuard(flushDenormals);
 
 			while (bufSize > 0)
 			{
-				int subBufSize = bufSize > BUFFER_SIZE ? BUFFER_SIZE : bufSize;
-				ProcessChunk(inL, inR, outLTemp, outRTemp, subBufSize);
-				Utils::Copy(outL, outLTemp, subBufSize);
-				Utils::Copy(outR, outRTemp, subBufSize);
-				inL = &inL[subBufSize];
-				inR = &inR[subBufSize];
-				outL = &outL[subBufSize];
-				outR = &outR[subBufSize];
+				auto position = samplePosition.load(std::memory_order_relaxed);
+				int subBufSize = bufSize > maxBlockSize ? maxBlockSize : bufSize;
+
+				// apply every change that is due, then stop the chunk where the next one falls
+				ParameterEvent ev;
+				while (parameterQueue.Peek(ev))
+				{
+					if (ev.SampleTime > position)
+					{
+						if (ev.SampleTime < position + subBufSize)
+							subBufSize = (int)(ev.SampleTime - position);
+						break;
+					}
+
+					SetParameter(ev.ParamId, ev.Value);
+					parameterQueue.Pop();
+				}
+
+				ProcessChunk(in, out, subBufSize);
+				in = in.Offset(subBufSize);
+				out = out.Offset(subBufSize);
 				bufSize -= subBufSize;
+				samplePosition.store(position + subBufSize, std::memory_order_relaxed);
 			}
 		}
 
 	private:
-		void ProcessChunk(float* inL, float* inR, float* outL, float* outR, int bufSize)
+		void AllocateWorkspace()
+		{
+			workspace.Reset(4 * BufferArena::Padded<T>(maxBlockSize));
+			leftChannelIn = workspace.Allocate<T>(maxBlockSize);
+			rightChannelIn = workspace.Allocate<T>(maxBlockSize);
+			silence = workspace.Allocate<T>(maxBlockSize);
+			tail = workspace.Allocate<T>(maxBlockSize);
+			Utils::ZeroBuffer(silence, maxBlockSize);
+		}
+
+		void ProcessChunk(const View& input, const View& output, int bufSize)
 		{
-			float leftChannelIn[BUFFER_SIZE];
-			float rightChannelIn[BUFFER_SIZE];
+			T inputMix = ScaleParam(parameters[Parameter::InputMix], Parameter::InputMix);
+			T cm = inputMix * 0.5;
+			T cmi = (1 - cm);
 
-			float inputMix = ScaleParam(parameters[Parameter::InputMix], Parameter::InputMix);
-			float cm = inputMix * 0.5;
-			float cmi = (1 - cm);
+			T* inL = input.Left;
+			T* inR = input.Right;
+			T* outL = output.Left;
+			T* outR = output.Right;
+			int outStride = output.Stride;
 
+			// Without input mixing the channels read planar input directly, unless writing one side's
+			// output would overwrite the other side's input before it is read.
+			// Otherwise the input mix deinterleaves as it goes.
+			T* leftIn = inL;
+			T* rightIn = inR;
+			if (input.Stride != 1)
+			{
+				leftIn = leftChannelIn;
+				rightIn = rightChannelIn;
+				int inStride = input.Stride;
+				for (int i = 0; i < bufSize; i++)
+				{
+					T l = inL[i * inStride];
+					T r = inR[i * inStride];
+					leftChannelIn[i] = l * cmi + r * cm;
+					rightChannelIn[i] = r * cmi + l * cm;
+				}
+			}
+			else if (cm != 0 || outL == inR || outR == inL)
+			{
+				leftIn = leftChannelIn;
+				rightIn = rightChannelIn;
+				for (int i = 0; i < bufSize; i++)
+				{
+					leftChannelIn[i] = inL[i] * cmi + inR[i] * cm;
+					rightChannelIn[i] = inR[i] * cmi + inL[i] * cm;
+				}
+			}
+
+			if (convolutionActive)
+			{
+				convolverL.Process(leftIn, outL, bufSize, outStride);
+				convolverR.Process(rightIn, outR, bufSize, outStride);
+				if (channelTail > 0)
+				{
+					RingOut(channelL, outL, bufSize, outStride);
+					RingOut(channelR, outR, bufSize, outStride);
+					channelTail -= bufSize;
+				}
+				return;
+			}
+
+			if (worker)
+			{
+				rightJobInput = rightIn;
+				rightJobOutput = outR;
+				rightJobOutputStride = outStride;
+				rightJobBufSize = bufSize;
+				worker->Run(&ProcessRightJob, this);
+				channelL.Process(leftIn, outL, bufSize, outStride);
+				worker->Wait();
+			}
+			else
+			{
+				channelL.Process(leftIn, outL, bufSize, outStride);
+				channelR.Process(rightIn, outR, bufSize, outStride);
+			}
+
+			if (convolutionTail > 0)
+			{
+				RingOut(convolverL, outL, bufSize, outStride);
+				RingOut(convolverR, outR, bufSize, outStride);
+				convolutionTail -= bufSize;
+			}
+		}
+
+		// Runs a channel or convolver with silent input and adds the result to output
+		template<typename TProcessor>
+		void RingOut(TProcessor& processor, T* output, int bufSize, int outStride)
+		{
+			processor.Process(silence, tail, bufSize);
 			for (int i = 0; i < bufSize; i++)
+				output[i * outStride] += tail[i];
+		}
+
+		void CaptureChannel(ChannelLR leftOrRight, int blockSize, float thresholdDb, float maxSeconds, std::vector<T>& impulse)
+		{
+			if (blockSize < 1)
+				blockSize = 1;
+
+			std::unique_ptr<ReverbChannel<T, TStorage>> channel(new ReverbChannel<T, TStorage>(samplerate, leftOrRight));
+			channel->SetSeed(seed);
+			channel->Prepare(blockSize);
+			for (int i = 0; i < Parameter::COUNT; i++)
+				channel->SetParameter(i, ScaleParam(parameters[i], i));
+			channel->SetLateDecimation(channelL.GetLateDecimation());
+			channel->ClearBuffers();
+
+			std::vector<T> inputBuffer(blockSize, 0.0f);
+			std::vector<T> outputBuffer(blockSize);
+			T* input = inputBuffer.data();
+			T* output = outputBuffer.data();
+
+			// sleep mode knows how long the delays take to drain, so it tells us when the response is over
+			channel->SetSleepMode(true, thresholdDb, 100);
+
+			input[0] = 1.0f;
+			auto maxLength = (size_t)(maxSeconds * samplerate);
+			impulse.clear();
+			while (impulse.size() < maxLength && !channel->IsSleeping())
 			{
-				leftChannelIn[i] = inL[i] * cmi + inR[i] * cm;
-				rightChannelIn[i] = inR[i] * cmi + inL[i] * cm;
+				channel->Process(input, output, blockSize);
+				impulse.insert(impulse.end(), output, output + blockSize);
+				input[0] = 0.0f;
 			}
 
-			channelL.Process(leftChannelIn, outL, bufSize);
-			channelR.Process(rightChannelIn, outR, bufSize);
+			auto threshold = Utils::DB2Gainf(thresholdDb);
+			auto length = std::min(impulse.size(), maxLength);
+			while (length > 1 && std::fabs(impulse[length - 1]) < threshold)
+				length--;
+			impulse.resize(length);
+		}
+
+		static void ProcessRightJob(void* context)
+		{
+			auto self = (BasicReverbController*)context;
+			DenormalGuard denormalGuard(self->flushDenormals);
+			self->channelR.Process(self->rightJobInput, self->rightJobOutput, self->rightJobBufSize, self->rightJobOutputStride);
 		}
 	};
+
+	typedef BasicReverbController<float> ReverbController;
 }
@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include "ReverbController.h"
+#include "WorkerThread.h"
+
+namespace Cloudseed
+{
+	struct ReverbJob
+	{
+		int Instance;
+		float* InL;
+		float* InR;
+		float* OutL;
+		float* OutR;
+		int BufSize;
+	};
+
+	// Owns many ReverbController instances and renders batches of blocks for them on a fixed pool of worker threads.
+	// Each batch is split evenly between the workers, the calling thread included. A worker first drains its own share
+	// and then steals the remaining jobs of the other workers, one job at a time, so uneven presets still balance out.
+	// A batch must not contain the same instance twice.
+	class ReverbEngine
+	{
+	private:
+		struct WorkerQueue
+		{
+			std::atomic<int> Next;
+			int End;
+			char Padding[64 - sizeof(std::atomic<int>) - sizeof(int)]; // keep each cursor on its own cache line
+		};
+
+		struct WorkerContext
+		{
+			ReverbEngine* Engine;
+			int WorkerIndex;
+		};
+
+		std::vector<std::unique_ptr<ReverbController>> instances;
+		std::vector<std::unique_ptr<WorkerThread>> workers;
+		std::unique_ptr<WorkerQueue[]> queues;
+		std::vector<WorkerContext> contexts;
+		int workerCount;
+
+		ReverbJob* batchJobs;
+
+	public:
+		// workerCount includes the calling thread, so workerCount = 1 processes everything on the caller.
+		// With pinWorkers, worker thread i is pinned to core i, leaving core 0 to the calling thread.
+		ReverbEngine(int samplerate, int instanceCount, int workerCount, bool pinWorkers = false)
+		{
+			if (workerCount < 1)
+				workerCount = 1;
+
+			this->workerCount = workerCount;
+			batchJobs = nullptr;
+
+			for (int i = 0; i < instanceCount; i++)
+				instances.emplace_back(new ReverbController(samplerate));
+
+			queues.reset(new WorkerQueue[workerCount]);
+			contexts.resize(workerCount);
+			for (int i = 0; i < workerCount; i++)
+			{
+				queues[i].Next = 0;
+				queues[i].End = 0;
+				contexts[i].Engine = this;
+				contexts[i].WorkerIndex = i;
+			}
+
+			for (int i = 1; i < workerCount; i++)
+				workers.emplace_back(new WorkerThread(pinWorkers ? i : -1));
+		}
+
+		int GetInstanceCount()
+		{
+			return (int)instances.size();
+		}
+
+		int GetWorkerCount()
+		{
+			return workerCount;
+		}
+
+		ReverbController& GetInstance(int index)
+		{
+			return *instances[index];
+		}
+
+		// Processes every job and returns once the whole batch is done
+		void ProcessBatch(ReverbJob* jobs, int jobCount)
+		{
+			batchJobs = jobs;
+
+			int perWorker = jobCount / workerCount;
+			int remainder = jobCount % workerCount;
+			int start = 0;
+			for (int i = 0; i < workerCount; i++)
+			{
+				int count = perWorker + (i < remainder ? 1 : 0);
+				queues[i].End = start + count;
+				queues[i].Next.store(start, std::memory_order_relaxed);
+				start += count;
+			}
+
+			// Run() publishes the queues to the workers
+			for (int i = 1; i < workerCount; i++)
+				workers[i - 1]->Run(&WorkerEntry, &contexts[i]);
+
+			RunWorker(0);
+
+			for (int i = 1; i < workerCount; i++)
+				workers[i - 1]->Wait();
+
+			batchJobs = nullptr;
+		}
+
+	private:
+		static void WorkerEntry(void* context)
+		{
+			auto ctx = (WorkerContext*)context;
+			ctx->Engine->RunWorker(ctx->WorkerIndex);
+		}
+
+		void RunWorker(int workerIndex)
+		{
+			// own queue first, then steal from the others, starting with the neighbour
+			for (int n = 0; n < workerCount; n++)
+			{
+				auto& queue = queues[(workerIndex + n) % workerCount];
+				while (true)
+				{
+					int jobIndex = queue.Next.fetch_add(1, std::memory_order_relaxed);
+					if (jobIndex >= queue.End)
+						break;
+
+					auto& job = batchJobs[jobIndex];
+					instances[job.Instance]->Process(job.InL, job.InR, job.OutL, job.OutR, job.BufSize);
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "../Parameters.h"
+#include "ReverbChannel.h"
+
+namespace Cloudseed
+{
+	// A program with everything derived from its parameters already computed for each channel: the scaled values,
+	// delay lengths, feedback gains, modulation rates, filter coefficients and seed tables. Compiling one costs as much
+	// as setting every parameter, and allocates, so do it off the audio thread. ApplyPreset on a controller then only
+	// copies the settings over, in time proportional to the number of lines.
+	// T and TStorage must match the controller, as must the samplerate, late decimation and channel count, otherwise
+	// ApplyPreset falls back to setting each parameter.
+	template<typename T, typename TStorage = T>
+	class BasicReverbPreset
+	{
+	private:
+		int samplerate;
+		int lateDecimation;
+		double parameters[(int)Parameter::COUNT] = {0};
+		std::vector<std::unique_ptr<ReverbChannel<T, TStorage>>> channels; // settings only, without buffers
+
+	public:
+		// values holds the Parameter::COUNT normalised parameter values, as passed to SetParameter.
+		// Two channels for ReverbController, or the channel count of a SurroundController.
+		template<typename TValue>
+		BasicReverbPreset(int samplerate, const TValue* values, int channelCount = 2, int lateDecimation = 1)
+		{
+			this->samplerate = samplerate;
+			this->lateDecimation = lateDecimation;
+			for (int i = 0; i < Parameter::COUNT; i++)
+				parameters[i] = values[i];
+
+			for (int k = 0; k < channelCount; k++)
+			{
+				channels.emplace_back(new ReverbChannel<T, TStorage>(samplerate, k, channelCount, false));
+				channels[k]->SetLateDecimation(lateDecimation);
+				for (int i = 0; i < Parameter::COUNT; i++)
+					channels[k]->SetParameter(i, ScaleParam(parameters[i], i));
+			}
+		}
+
+		int GetSamplerate() const
+		{
+			return samplerate;
+		}
+
+		int GetLateDecimation() const
+		{
+			return lateDecimation;
+		}
+
+		int GetChannelCount() const
+		{
+			return (int)channels.size();
+		}
+
+		double GetParameter(int paramId) const
+		{
+			return parameters[paramId];
+		}
+
+		const ReverbChannel<T, TStorage>& GetChannel(int index) const
+		{
+			return *channels[index];
+		}
+	};
+
+	typedef BasicReverbPreset<float> ReverbPreset;
+}
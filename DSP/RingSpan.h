@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+namespace Cloudseed
+{
+	// Helpers for ring buffers with a power of two capacity, addressed with index & (capacity - 1).
+	// Instead of wrapping the index on every sample, a block is split into at most two runs that are contiguous
+	// in memory, and each run is processed with a plain loop that has no wrap check in it.
+	class RingSpan
+	{
+	public:
+		// Smallest power of two capacity that holds minSize samples
+		static constexpr int Capacity(int minSize)
+		{
+			int capacity = 1;
+			while (capacity < minSize)
+				capacity <<= 1;
+			return capacity;
+		}
+
+		// Largest power of two capacity that fits in a buffer of size samples
+		static int CapacityWithin(int size)
+		{
+			if (size < 1)
+				return 0;
+			int capacity = 1;
+			while (capacity * 2 <= size)
+				capacity <<= 1;
+			return capacity;
+		}
+
+		// Calls fn(position, offset, length) for each contiguous run covering count samples from ring position start.
+		// position is where the run starts in the ring, offset where it starts in the block.
+		template<typename Fn>
+		static inline void ForEach(int start, int count, int mask, Fn fn)
+		{
+			start &= mask;
+			int first = mask + 1 - start;
+			if (first >= count)
+			{
+				fn(start, 0, count);
+				return;
+			}
+
+			fn(start, 0, first);
+			fn(0, first, count - first);
+		}
+
+		// Fills the newest frames of dest, a ring of destMask + 1 frames whose next write position is destWrite, with the
+		// history of source as if it had been recorded at ratio times the rate, interpolating linearly. A frame is lanes
+		// interleaved values, converted with Storage, see SampleStorage. At most frames are filled, and none older than
+		// source reaches back, the rest of dest is left as it is.
+		template<typename Storage, typename TStorage>
+		static void Resample(const TStorage* source, int sourceMask, int sourceWrite,
+			TStorage* dest, int destMask, int destWrite, int frames, double ratio, int lanes = 1)
+		{
+			int available = (int)(sourceMask * ratio); // the oldest source frame only serves as the second interpolation point
+			if (frames > available)
+				frames = available;
+			if (frames > destMask + 1)
+				frames = destMask + 1;
+
+			double step = 1 / ratio;
+			for (int k = 0; k < frames; k++)
+			{
+				double position = k * step;
+				int back = (int)position;
+				auto frac = (float)(position - back);
+				const TStorage* a = &source[((sourceWrite - 1 - back) & sourceMask) * lanes];
+				const TStorage* b = &source[((sourceWrite - 2 - back) & sourceMask) * lanes];
+				TStorage* d = &dest[((destWrite - 1 - k) & destMask) * lanes];
+				for (int l = 0; l < lanes; l++)
+					d[l] = Storage::Encode(Storage::Decode(a[l]) * (1 - frac) + Storage::Decode(b[l]) * frac);
+			}
+		}
+	};
+}
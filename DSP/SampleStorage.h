@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "HalfFloat.h"
+
+namespace Cloudseed
+{
+	// How delay buffers keep their history. The delays compute in the sample type T and store every sample they
+	// write as a TStorage, converting on the way in and out. By default the history is stored as T itself and
+	// the conversions compile away. A narrower TStorage trades precision for memory and memory bandwidth.
+	template<typename T, typename TStorage>
+	struct SampleStorage
+	{
+		static inline TStorage Encode(T value)
+		{
+			return (TStorage)value;
+		}
+
+		static inline T Decode(TStorage value)
+		{
+			return (T)value;
+		}
+
+		static inline void Store(TStorage* dest, const T* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = Encode(source[i]);
+		}
+
+		static inline void Load(T* dest, const TStorage* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = Decode(source[i]);
+		}
+
+		// Every storage type has an all zero bit pattern for silence
+		static inline void Clear(TStorage* buffer, int len)
+		{
+			if (buffer != nullptr)
+				memset(buffer, 0, len * sizeof(TStorage));
+		}
+	};
+
+	// 16 bit fixed point, with 12dB of headroom above full scale, so the feedback paths can run hot without clipping.
+	// Values beyond +-4.0 are clamped. Quantisation noise sits around -84dB below full scale.
+	template<typename T>
+	struct SampleStorage<T, int16_t>
+	{
+		static constexpr double Headroom = 4.0;
+
+		// Offset to a positive range, so rounding is a plain truncation and the loops vectorise without branches
+		static inline int16_t Encode(T value)
+		{
+			T scaled = value * (T)(32767 / Headroom) + (T)32768.5;
+			scaled = scaled < 1 ? 1 : scaled;
+			scaled = scaled > 65535 ? 65535 : scaled;
+			return (int16_t)((int32_t)scaled - 32768);
+		}
+
+		static inline T Decode(int16_t value)
+		{
+			return value * (T)(Headroom / 32767);
+		}
+
+		static inline void Store(int16_t* dest, const T* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = Encode(source[i]);
+		}
+
+		static inline void Load(T* dest, const int16_t* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = Decode(source[i]);
+		}
+
+		static inline void Clear(int16_t* buffer, int len)
+		{
+			if (buffer != nullptr)
+				memset(buffer, 0, len * sizeof(int16_t));
+		}
+	};
+
+	// 16 bit floating point, Half or BFloat16. The sample type goes through float on the way in and out,
+	// and whole runs of float samples convert in bulk, with F16C where available.
+	template<typename T, typename TFloat16>
+	struct Float16Storage
+	{
+		static inline TFloat16 Encode(T value)
+		{
+			return TFloat16::FromFloat((float)value);
+		}
+
+		static inline T Decode(TFloat16 value)
+		{
+			return (T)value.ToFloat();
+		}
+
+		template<typename TSource>
+		static inline void Store(TFloat16* dest, const TSource* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = Encode(source[i]);
+		}
+
+		static inline void Store(TFloat16* dest, const float* source, int len)
+		{
+			TFloat16::FromFloat(dest, source, len);
+		}
+
+		template<typename TDest>
+		static inline void Load(TDest* dest, const TFloat16* source, int len)
+		{
+			for (int i = 0; i < len; i++)
+				dest[i] = Decode(source[i]);
+		}
+
+		static inline void Load(float* dest, const TFloat16* source, int len)
+		{
+			TFloat16::ToFloat(dest, source, len);
+		}
+
+		static inline void Clear(TFloat16* buffer, int len)
+		{
+			if (buffer != nullptr)
+				memset(buffer, 0, len * sizeof(TFloat16));
+		}
+	};
+
+	template<typename T>
+	struct SampleStorage<T, Half> : Float16Storage<T, Half> { };
+
+	template<typename T>
+	struct SampleStorage<T, BFloat16> : Float16Storage<T, BFloat16> { };
+}
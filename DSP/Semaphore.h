@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#endif
+
+namespace Cloudseed
+{
+	// A counting semaphore on the platform's own primitive. Post takes no lock, so it is safe to call from the audio
+	// thread; on Linux and macOS it only enters the kernel when a thread is waiting.
+	class Semaphore
+	{
+	private:
+#if defined(_WIN32)
+		HANDLE handle;
+#elif defined(__APPLE__)
+		dispatch_semaphore_t handle;
+#else
+		sem_t handle;
+#endif
+
+	public:
+		Semaphore()
+		{
+#if defined(_WIN32)
+			handle = CreateSemaphore(nullptr, 0, 0x7fffffff, nullptr);
+#elif defined(__APPLE__)
+			handle = dispatch_semaphore_create(0);
+#else
+			sem_init(&handle, 0, 0);
+#endif
+		}
+
+		~Semaphore()
+		{
+#if defined(_WIN32)
+			CloseHandle(handle);
+#elif defined(__APPLE__)
+			dispatch_release(handle);
+#else
+			sem_destroy(&handle);
+#endif
+		}
+
+		Semaphore(const Semaphore&) = delete;
+		Semaphore& operator=(const Semaphore&) = delete;
+
+		void Post()
+		{
+#if defined(_WIN32)
+			ReleaseSemaphore(handle, 1, nullptr);
+#elif defined(__APPLE__)
+			dispatch_semaphore_signal(handle);
+#else
+			sem_post(&handle);
+#endif
+		}
+
+		// Blocks until the count is above zero, and takes one from it
+		void Wait()
+		{
+#if defined(_WIN32)
+			WaitForSingleObject(handle, INFINITE);
+#elif defined(__APPLE__)
+			dispatch_semaphore_wait(handle, DISPATCH_TIME_FOREVER);
+#else
+			while (sem_wait(&handle) != 0 && errno == EINTR) { }
+#endif
+		}
+	};
+}
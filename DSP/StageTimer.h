@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#ifdef CLOUDSEED_STAGE_TIMING
+#include <chrono>
+#endif
+
+namespace Cloudseed
+{
+	namespace Stage
+	{
+		const int InputFilters = 0;
+		const int PreDelay = 1;
+		const int Multitap = 2;
+		const int Diffuser = 3;
+		const int OutputMix = 4;
+		const int LateBank = 5; // one slot per bank of late lines, LateBank + bankIndex
+
+		const int MaxLateBanks = 12;
+		const int COUNT = LateBank + MaxLateBanks;
+	}
+
+	// Accumulates the time spent in each stage of ReverbChannel::Process.
+	// Compiles down to nothing unless CLOUDSEED_STAGE_TIMING is defined, so it can stay in the release signal path.
+	class StageTimer
+	{
+#ifdef CLOUDSEED_STAGE_TIMING
+	private:
+		std::chrono::steady_clock::time_point lapStart;
+		uint64_t nanos[Stage::COUNT];
+
+	public:
+		StageTimer()
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			for (int i = 0; i < Stage::COUNT; i++)
+				nanos[i] = 0;
+		}
+
+		inline void Start()
+		{
+			lapStart = std::chrono::steady_clock::now();
+		}
+
+		// charges the time since the last Start() or Lap() to the given stage
+		inline void Lap(int stage)
+		{
+			auto now = std::chrono::steady_clock::now();
+			nanos[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - lapStart).count();
+			lapStart = now;
+		}
+
+		uint64_t GetNanos(int stage)
+		{
+			return nanos[stage];
+		}
+#else
+	public:
+		inline void Reset() { }
+		inline void Start() { }
+		inline void Lap(int) { }
+		inline uint64_t GetNanos(int) { return 0; }
+#endif
+	};
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "HalfFloat.h"
+#include "RingSpan.h"
+
+namespace Cloudseed
+{
+	// Identifies a sample or storage type in a state snapshot, so a snapshot is only restored into the same types
+	template<typename TValue> struct StateTypeId;
+	template<> struct StateTypeId<float> { static const uint32_t Value = 1; };
+	template<> struct StateTypeId<double> { static const uint32_t Value = 2; };
+	template<> struct StateTypeId<int16_t> { static const uint32_t Value = 3; };
+	template<> struct StateTypeId<Half> { static const uint32_t Value = 4; };
+	template<> struct StateTypeId<BFloat16> { static const uint32_t Value = 5; };
+
+	// Appends the runtime state of the DSP classes to a byte buffer, see ReverbController::SaveState.
+	// Values are written as they are in memory, in the byte order of the machine.
+	class StateWriter
+	{
+	private:
+		std::vector<uint8_t>& data;
+
+	public:
+		StateWriter(std::vector<uint8_t>& data) : data(data)
+		{
+		}
+
+		template<typename TValue>
+		void Write(const TValue& value)
+		{
+			Write(&value, 1);
+		}
+
+		template<typename TValue>
+		void Write(const TValue* values, int count)
+		{
+			auto bytes = (const uint8_t*)values;
+			data.insert(data.end(), bytes, bytes + count * sizeof(TValue));
+		}
+
+		// The newest frames of a ring of mask + 1 frames, lanes values each, whose next write position is end.
+		// Only these are stored, anything older in the ring is left out.
+		template<typename TValue>
+		void WriteRing(const TValue* ring, int mask, int end, int frames, int lanes = 1)
+		{
+			Write(frames);
+			if (frames > 0)
+				RingSpan::ForEach(end - frames, frames, mask, [&](int pos, int, int len)
+				{
+					Write(&ring[pos * lanes], len * lanes);
+				});
+		}
+	};
+
+	// Reads back what StateWriter wrote. Reading past the end, or a ring that doesn't fit, marks the reader as failed,
+	// after which every read returns zeros, so the caller only needs to check Failed() once at the end.
+	class StateReader
+	{
+	private:
+		const uint8_t* data;
+		size_t size;
+		size_t position;
+		bool failed;
+
+	public:
+		StateReader(const uint8_t* data, size_t size)
+		{
+			this->data = data;
+			this->size = size;
+			position = 0;
+			failed = false;
+		}
+
+		bool Failed()
+		{
+			return failed;
+		}
+
+		void Fail()
+		{
+			failed = true;
+		}
+
+		size_t GetRemaining()
+		{
+			return failed ? 0 : size - position;
+		}
+
+		template<typename TValue>
+		TValue Read()
+		{
+			TValue value;
+			Read(&value, 1);
+			return value;
+		}
+
+		template<typename TValue>
+		void Read(TValue* values, int count)
+		{
+			size_t bytes = count * sizeof(TValue);
+			if (count < 0 || bytes > GetRemaining())
+			{
+				failed = true;
+				if (count > 0)
+					memset((void*)values, 0, bytes);
+				return;
+			}
+
+			memcpy((void*)values, &data[position], bytes);
+			position += bytes;
+		}
+
+		// Reads a ring written by WriteRing into the newest frames of a ring of mask + 1 frames, whose next write
+		// position is end. Returns the number of frames read.
+		template<typename TValue>
+		int ReadRing(TValue* ring, int mask, int end, int lanes = 1)
+		{
+			int frames = Read<int>();
+			if (frames < 0 || frames > mask + 1 || (frames > 0 && ring == nullptr))
+			{
+				failed = true;
+				return 0;
+			}
+
+			if (frames > 0)
+				RingSpan::ForEach(end - frames, frames, mask, [&](int pos, int, int len)
+				{
+					Read(&ring[pos * lanes], len * lanes);
+				});
+			return failed ? 0 : frames;
+		}
+	};
+
+	// The start of every snapshot, describing what it was saved from, so it can be checked before anything is restored
+	struct StateHeader
+	{
+		static const uint32_t Magic = 0x53525343; // "CSRS"
+		static const uint32_t CurrentVersion = 1;
+
+		uint32_t Version;
+		uint32_t SampleType; // see StateTypeId
+		uint32_t StorageType;
+		int ChannelCount;
+		int Samplerate;
+		int LateDecimation;
+
+		void Write(StateWriter& writer)
+		{
+			writer.Write((uint32_t)Magic);
+			writer.Write(Version);
+			writer.Write(SampleType);
+			writer.Write(StorageType);
+			writer.Write(ChannelCount);
+			writer.Write(Samplerate);
+			writer.Write(LateDecimation);
+		}
+
+		// False if the data is not a snapshot, or one written by a later version
+		bool Read(StateReader& reader)
+		{
+			if (reader.Read<uint32_t>() != Magic)
+				return false;
+			Version = reader.Read<uint32_t>();
+			SampleType = reader.Read<uint32_t>();
+			StorageType = reader.Read<uint32_t>();
+			ChannelCount = reader.Read<int>();
+			Samplerate = reader.Read<int>();
+			LateDecimation = reader.Read<int>();
+			return !reader.Failed() && Version >= 1 && Version <= CurrentVersion;
+		}
+	};
+}
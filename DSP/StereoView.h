@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+namespace Cloudseed
+{
+	// Non-owning view of a block of stereo audio. Sample i of the left channel is at Left[i * Stride],
+	// of the right channel at Right[i * Stride]. Planar buffers have a stride of 1. Interleaved audio has a stride
+	// of the channel count, with both pointers into the same buffer.
+	template<typename T>
+	struct BasicStereoView
+	{
+		T* Left;
+		T* Right;
+		int Stride;
+
+		static BasicStereoView Planar(T* left, T* right)
+		{
+			return BasicStereoView{ left, right, 1 };
+		}
+
+		// channels[0] is the left channel, channels[1] the right, as hosts usually pass them
+		static BasicStereoView Planar(T* const* channels)
+		{
+			return BasicStereoView{ channels[0], channels[1], 1 };
+		}
+
+		// Frames of channelCount samples. The stereo pair is taken from firstChannel and the channel after it,
+		// the other channels are neither read nor written.
+		static BasicStereoView Interleaved(T* data, int channelCount = 2, int firstChannel = 0)
+		{
+			return BasicStereoView{ &data[firstChannel], &data[firstChannel + 1], channelCount };
+		}
+
+		// The view starting frames later
+		BasicStereoView Offset(int frames) const
+		{
+			return BasicStereoView{ &Left[frames * Stride], &Right[frames * Stride], Stride };
+		}
+	};
+
+	typedef BasicStereoView<float> StereoView;
+}
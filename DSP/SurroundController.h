@@ -0,0 +1,481 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "../Parameters.h"
+#include "ReverbChannel.h"
+#include "ReverbPreset.h"
+#include "Utils.h"
+#include "WorkerThread.h"
+#include "DenormalGuard.h"
+#include "BufferArena.h"
+#include "StateStream.h"
+
+namespace Cloudseed
+{
+	// Reverb for any number of channels, one ReverbChannel per channel. Every channel gets its own variation of the
+	// seeds, so the channels are decorrelated the same way the left and right channel of ReverbController are, and
+	// EqCrossSeed blends them towards each other. The input of each channel is a mix of all the inputs, given by an
+	// input matrix that defaults to the InputMix parameter spread evenly over the other channels.
+	// With two channels and the default matrix, the output is the same as ReverbController.
+	// T and TStorage are the sample and delay storage type, as for BasicReverbController.
+	template<typename T, typename TStorage = T>
+	class BasicSurroundController
+	{
+	private:
+		struct WorkerJob
+		{
+			BasicSurroundController* Controller;
+			int Thread;
+		};
+
+		int samplerate;
+		int channelCount;
+		int maxBlockSize;
+		uint64_t seed;
+
+		// Scratch for one block, see Prepare
+		BufferArena workspace;
+		T* mixBuffer; // channelCount blocks, the mixed input of each channel
+		int mixStride;
+
+		std::vector<std::unique_ptr<ReverbChannel<T, TStorage>>> channels;
+		double parameters[(int)Parameter::COUNT] = {0};
+
+		// channelCount x channelCount, row major, row k holds the gain of every input into channel k
+		std::vector<T> inputMatrix;
+		bool defaultInputMatrix;
+
+		// The block being processed, set up by ProcessChunk
+		std::vector<T*> channelInputs;
+		std::vector<T*> channelOutputs;
+		std::vector<T*> interleavedInputs;
+		std::vector<T*> interleavedOutputs;
+		int outputStride;
+		int jobBufSize;
+
+		// Optional workers, channel k runs on thread k % (workers + 1), thread 0 being the caller
+		std::vector<std::unique_ptr<WorkerThread>> workers;
+		std::vector<WorkerJob> jobs;
+
+		bool flushDenormals;
+
+	public:
+		// See ReverbController::SetSeed
+		BasicSurroundController(int samplerate, int channelCount, uint64_t seed = 0)
+		{
+			if (channelCount < 1)
+				channelCount = 1;
+
+			this->samplerate = samplerate;
+			this->channelCount = channelCount;
+			for (int i = 0; i < channelCount; i++)
+				channels.emplace_back(new ReverbChannel<T, TStorage>(samplerate, i, channelCount));
+			SetSeed(seed);
+
+			maxBlockSize = channels[0]->GetMaxBlockSize();
+			AllocateWorkspace();
+			inputMatrix.resize(channelCount * channelCount);
+			channelInputs.resize(channelCount);
+			channelOutputs.resize(channelCount);
+			interleavedInputs.resize(channelCount);
+			interleavedOutputs.resize(channelCount);
+			outputStride = 1;
+			jobBufSize = 0;
+			flushDenormals = true;
+			SetInputMatrix(nullptr);
+		}
+
+		int GetChannelCount()
+		{
+			return channelCount;
+		}
+
+		int GetSamplerate()
+		{
+			return samplerate;
+		}
+
+		// Same as ReverbController::SetSeed, every channel draws its own phases from the seed.
+		// Channels 0 and 1 draw the same phases as the left and right channel of a ReverbController with this seed.
+		void SetSeed(uint64_t seed)
+		{
+			this->seed = seed;
+			for (auto& channel : channels)
+				channel->SetSeed(seed);
+		}
+
+		uint64_t GetSeed()
+		{
+			return seed;
+		}
+
+		// Same as ReverbController::SetSamplerate
+		void SetSamplerate(int samplerate, bool keepState = false)
+		{
+			this->samplerate = samplerate;
+			for (auto& channel : channels)
+				channel->SetSamplerate(samplerate, keepState);
+		}
+
+		// Same as ReverbController::Prepare
+		void Prepare(int maxBlockSize)
+		{
+			this->maxBlockSize = maxBlockSize < 1 ? 1 : maxBlockSize;
+			AllocateWorkspace();
+			for (auto& channel : channels)
+				channel->Prepare(this->maxBlockSize);
+		}
+
+		int GetMaxBlockSize()
+		{
+			return maxBlockSize;
+		}
+
+		int GetParameterCount()
+		{
+			return Parameter::COUNT;
+		}
+
+		double* GetAllParameters()
+		{
+			return parameters;
+		}
+
+		// Applies the change immediately, not safe to call while Process is running on another thread
+		void SetParameter(int paramId, double value)
+		{
+			parameters[paramId] = value;
+			auto scaled = ScaleParam(value, paramId);
+			for (auto& channel : channels)
+				channel->SetParameter(paramId, scaled);
+
+			if (paramId == Parameter::InputMix && defaultInputMatrix)
+				UpdateDefaultInputMatrix();
+		}
+
+		// Same as ReverbController::ApplyPreset, the preset must be compiled for this channel count
+		void ApplyPreset(const BasicReverbPreset<T, TStorage>& preset)
+		{
+			if (preset.GetSamplerate() != samplerate || preset.GetLateDecimation() != channels[0]->GetLateDecimation()
+				|| preset.GetChannelCount() != channelCount)
+			{
+				for (int i = 0; i < Parameter::COUNT; i++)
+					SetParameter(i, preset.GetParameter(i));
+				return;
+			}
+
+			for (int i = 0; i < Parameter::COUNT; i++)
+				parameters[i] = preset.GetParameter(i);
+			for (int k = 0; k < channelCount; k++)
+				channels[k]->CopySettings(preset.GetChannel(k));
+
+			if (defaultInputMatrix)
+				UpdateDefaultInputMatrix();
+		}
+
+		// Sets the gain of every input into every channel, channelCount x channelCount values, row major, so that
+		// matrix[k * channelCount + j] is the gain of input j into channel k. The InputMix parameter has no effect
+		// while a matrix is set. nullptr goes back to the default matrix, which keeps 1 - InputMix / 2 of each
+		// channel's own input and spreads InputMix / 2 evenly over the others.
+		void SetInputMatrix(const T* matrix)
+		{
+			defaultInputMatrix = matrix == nullptr;
+			if (defaultInputMatrix)
+				UpdateDefaultInputMatrix();
+			else
+				inputMatrix.assign(matrix, matrix + channelCount * channelCount);
+		}
+
+		const T* GetInputMatrix()
+		{
+			return inputMatrix.data();
+		}
+
+		// Processes the channels on workerCount extra threads next to the calling thread, 0 processes everything on
+		// the caller. Channels are dealt out round robin, so channelCount - 1 workers give every channel its own thread.
+		// With pinWorkers, worker i is pinned to core i + 1, leaving core 0 to the calling thread.
+		// Creates or destroys threads, so call this from a non-realtime thread, never concurrently with Process.
+		void SetWorkerCount(int workerCount, bool pinWorkers = false)
+		{
+			if (workerCount < 0)
+				workerCount = 0;
+			if (workerCount > channelCount - 1)
+				workerCount = channelCount - 1;
+
+			workers.clear();
+			jobs.clear();
+			for (int i = 0; i < workerCount; i++)
+				workers.emplace_back(new WorkerThread(pinWorkers ? i + 1 : -1));
+			for (int i = 0; i <= workerCount; i++)
+				jobs.push_back({ this, i });
+		}
+
+		int GetWorkerCount()
+		{
+			return (int)workers.size();
+		}
+
+		// See ReverbController::SetSleepMode
+		void SetSleepMode(bool enabled, float thresholdDb = -100, float holdMillis = 200)
+		{
+			for (auto& channel : channels)
+				channel->SetSleepMode(enabled, thresholdDb, holdMillis);
+		}
+
+		bool IsSleeping()
+		{
+			for (auto& channel : channels)
+			{
+				if (!channel->IsSleeping())
+					return false;
+			}
+			return true;
+		}
+
+		// See ReverbController::SetFlushDenormals, applies to the workers as well
+		void SetFlushDenormals(bool enabled)
+		{
+			flushDenormals = enabled;
+		}
+
+		bool GetFlushDenormals()
+		{
+			return flushDenormals;
+		}
+
+		void SetInputSquelch(bool enabled)
+		{
+			for (auto& channel : channels)
+				channel->SetInputSquelch(enabled);
+		}
+
+		// See ReverbController::SetLateDecimation
+		void SetLateDecimation(int factor)
+		{
+			for (auto& channel : channels)
+				channel->SetLateDecimation(factor);
+		}
+
+		void SetModulationUpdateRate(int samples)
+		{
+			for (auto& channel : channels)
+				channel->SetModulationUpdateRate(samples);
+		}
+
+		void ClearBuffers()
+		{
+			for (auto& channel : channels)
+				channel->ClearBuffers();
+		}
+
+		// Same as ReverbController::SaveState, for every channel. The input matrix is a setting and not included.
+		void SaveState(std::vector<uint8_t>& data)
+		{
+			StateWriter writer(data);
+			StateHeader header;
+			header.Version = StateHeader::CurrentVersion;
+			header.SampleType = StateTypeId<T>::Value;
+			header.StorageType = StateTypeId<TStorage>::Value;
+			header.ChannelCount = channelCount;
+			header.Samplerate = samplerate;
+			header.LateDecimation = channels[0]->GetLateDecimation();
+			header.Write(writer);
+
+			writer.Write((int)Parameter::COUNT);
+			writer.Write(parameters, Parameter::COUNT);
+			for (auto& channel : channels)
+				channel->SaveState(writer);
+		}
+
+		// Same as ReverbController::RestoreState, the snapshot must be of a SurroundController with this channel count
+		bool RestoreState(const uint8_t* data, size_t size)
+		{
+			StateReader reader(data, size);
+			StateHeader header;
+			if (!header.Read(reader) || header.SampleType != StateTypeId<T>::Value || header.StorageType != StateTypeId<TStorage>::Value
+				|| header.ChannelCount != channelCount || header.Samplerate <= 0 || reader.Read<int>() != Parameter::COUNT)
+				return false;
+			if (header.LateDecimation != 1 && header.LateDecimation != 2 && header.LateDecimation != 4)
+				return false;
+
+			double values[Parameter::COUNT];
+			reader.Read(values, Parameter::COUNT);
+			if (reader.Failed())
+				return false;
+
+			if (header.Samplerate != samplerate)
+				SetSamplerate(header.Samplerate);
+			if (header.LateDecimation != channels[0]->GetLateDecimation())
+				SetLateDecimation(header.LateDecimation);
+			for (int i = 0; i < Parameter::COUNT; i++)
+				SetParameter(i, values[i]);
+			ClearBuffers();
+
+			for (auto& channel : channels)
+				channel->LoadState(reader);
+
+			if (reader.Failed())
+			{
+				ClearBuffers();
+				return false;
+			}
+			return true;
+		}
+
+		// Planar buffers, one per channel. The output may be the same memory as the input.
+		void Process(T* const* input, T* const* output, int bufSize)
+		{
+			Process(input, 1, output, 1, bufSize);
+		}
+
+		// Interleaved frames of channelCount samples. Input and output may be the same buffer.
+		void ProcessInterleaved(T* input, T* output, int frames)
+		{
+			for (int k = 0; k < channelCount; k++)
+			{
+				interleavedInputs[k] = &input[k];
+				interleavedOutputs[k] = &output[k];
+			}
+			Process(interleavedInputs.data(), channelCount, interleavedOutputs.data(), channelCount, frames);
+		}
+
+	private:
+		void AllocateWorkspace()
+		{
+			mixStride = (int)(BufferArena::Padded<T>(maxBlockSize) / sizeof(T));
+			workspace.Reset(BufferArena::Padded<T>(channelCount * mixStride));
+			mixBuffer = workspace.Allocate<T>(channelCount * mixStride);
+		}
+
+		void UpdateDefaultInputMatrix()
+		{
+			T inputMix = ScaleParam(parameters[Parameter::InputMix], Parameter::InputMix);
+			T cm = inputMix * 0.5;
+			T cmi = (1 - cm);
+			T spread = channelCount > 1 ? cm / (channelCount - 1) : 0;
+
+			for (int k = 0; k < channelCount; k++)
+			{
+				for (int j = 0; j < channelCount; j++)
+					inputMatrix[k * channelCount + j] = j == k ? (channelCount > 1 ? cmi : 1) : spread;
+			}
+		}
+
+		void Process(T* const* input, int inputStride, T* const* output, int outputStride, int bufSize)
+		{
+			DenormalGuard denormalGuard(flushDenormals);
+			int offset = 0;
+
+			while (offset < bufSize)
+			{
+				int subBufSize = bufSize - offset > maxBlockSize ? maxBlockSize : bufSize - offset;
+				ProcessChunk(input, inputStride, output, outputStride, offset, subBufSize);
+				offset += subBufSize;
+			}
+		}
+
+		void ProcessChunk(T* const* input, int inputStride, T* const* output, int outputStride, int offset, int bufSize)
+		{
+			// The channels read planar input directly when the matrix passes it straight through, unless a channel's
+			// output would overwrite the input of another channel before that one has read it
+			bool direct = inputStride == 1;
+			for (int k = 0; k < channelCount && direct; k++)
+			{
+				for (int j = 0; j < channelCount; j++)
+				{
+					if (inputMatrix[k * channelCount + j] != (j == k ? 1 : 0) || (j != k && output[k] == input[j]))
+					{
+						direct = false;
+						break;
+					}
+				}
+			}
+
+			for (int k = 0; k < channelCount; k++)
+			{
+				T* mixed = &mixBuffer[k * mixStride];
+				channelInputs[k] = direct ? &input[k][offset] : mixed;
+				channelOutputs[k] = &output[k][offset * outputStride];
+				if (!direct)
+					MixInput(&inputMatrix[k * channelCount], input, inputStride, offset, mixed, bufSize);
+			}
+
+			this->outputStride = outputStride;
+			jobBufSize = bufSize;
+
+			for (size_t i = 0; i < workers.size(); i++)
+				workers[i]->Run(&ProcessJob, &jobs[i + 1]);
+
+			ProcessThread(0);
+
+			for (auto& worker : workers)
+				worker->Wait();
+		}
+
+		void MixInput(const T* gains, T* const* input, int inputStride, int offset, T* output, int bufSize)
+		{
+			bool first = true;
+			for (int j = 0; j < channelCount; j++)
+			{
+				T gain = gains[j];
+				if (gain == 0)
+					continue;
+
+				const T* in = &input[j][offset * inputStride];
+				if (first)
+				{
+					for (int i = 0; i < bufSize; i++)
+						output[i] = in[i * inputStride] * gain;
+				}
+				else
+				{
+					for (int i = 0; i < bufSize; i++)
+						output[i] += in[i * inputStride] * gain;
+				}
+				first = false;
+			}
+
+			if (first)
+				Utils::ZeroBuffer(output, bufSize);
+		}
+
+		void ProcessThread(int thread)
+		{
+			int threadCount = (int)workers.size() + 1;
+			for (int k = thread; k < channelCount; k += threadCount)
+				channels[k]->Process(channelInputs[k], channelOutputs[k], jobBufSize, outputStride);
+		}
+
+		static void ProcessJob(void* context)
+		{
+			auto job = (WorkerJob*)context;
+			DenormalGuard denormalGuard(job->Controller->flushDenormals);
+			job->Controller->ProcessThread(job->Thread);
+		}
+	};
+
+	typedef BasicSurroundController<float> SurroundController;
+}
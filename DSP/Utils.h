@@ -22,9 +22,12 @@ THE SOFTWARE.
 
 #pragma once
 
+#ifndef _USE_MATH_DEFINES
 #define _USE_MATH_DEFINES 1
+#endif
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 namespace Cloudseed
 {
@@ -38,7 +41,7 @@ namespace Cloudseed
         }
 
         template<typename T>
-        inline void Copy(T* dest, T* source, int len)
+        inline void Copy(T* dest, const T* source, int len)
         {
             memcpy(dest, source, len * sizeof(T));
         }
@@ -59,6 +62,19 @@ namespace Cloudseed
                 target[i] += source[i] * gain;
         }
 
+        template<typename T>
+        inline T Peak(const T* buffer, int len)
+        {
+            T peak = 0;
+            for (int i = 0; i < len; i++)
+            {
+                T val = buffer[i] < 0 ? -buffer[i] : buffer[i];
+                if (val > peak)
+                    peak = val;
+            }
+            return peak;
+        }
+
         inline float DB2Gainf(float input)
         {
             //return std::pow(10.0f, input / 20.0f);
@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+#include "Semaphore.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLOUDSEED_CPU_RELAX() _mm_pause()
+#else
+#define CLOUDSEED_CPU_RELAX() std::this_thread::yield()
+#endif
+
+namespace Cloudseed
+{
+	// A persistent thread that runs one job at a time on behalf of the audio thread.
+	// Handing over a job is a single atomic increment, nothing is allocated or locked per job.
+	// Between jobs the worker spins for spinCount iterations, so jobs that follow each other closely are picked up
+	// immediately, then parks on a semaphore. The default is well under one audio block, so in realtime use the worker
+	// usually parks between blocks, and Run posts the semaphore: a system call, but no lock.
+	class WorkerThread
+	{
+	public:
+		typedef void (*JobFunction)(void* context);
+
+	private:
+		std::atomic<uint32_t> requested;
+		std::atomic<uint32_t> completed;
+		std::atomic<bool> parked;
+		std::atomic<bool> running;
+		Semaphore wake;
+		JobFunction job;
+		void* jobContext;
+		int spinCount;
+		std::thread thread;
+
+	public:
+		// cpuCore < 0 leaves the thread unpinned
+		WorkerThread(int cpuCore = -1, int spinCount = 20000) :
+			requested(0),
+			completed(0),
+			parked(false),
+			running(true)
+		{
+			this->spinCount = spinCount;
+			job = nullptr;
+			jobContext = nullptr;
+			thread = std::thread(&WorkerThread::Loop, this);
+			if (cpuCore >= 0)
+				SetAffinity(cpuCore);
+		}
+
+		~WorkerThread()
+		{
+			running = false;
+			if (parked.exchange(false))
+				wake.Post();
+			thread.join();
+		}
+
+		WorkerThread(const WorkerThread&) = delete;
+		WorkerThread& operator=(const WorkerThread&) = delete;
+
+		// Starts the job on the worker. Must be followed by Wait() before the next call.
+		void Run(JobFunction function, void* context)
+		{
+			job = function;
+			jobContext = context;
+			requested.fetch_add(1);
+
+			// whoever clears parked posts the one wake the worker waits for
+			if (parked.load() && parked.exchange(false))
+				wake.Post();
+		}
+
+		// Blocks until the last job handed to Run() has finished
+		void Wait()
+		{
+			auto target = requested.load(std::memory_order_relaxed);
+			int spins = 0;
+			while (completed.load(std::memory_order_acquire) != target)
+			{
+				if (++spins < spinCount)
+					CLOUDSEED_CPU_RELAX();
+				else
+					std::this_thread::yield();
+			}
+		}
+
+		bool SetAffinity(int cpuCore)
+		{
+#if defined(_WIN32)
+			return SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << cpuCore) != 0;
+#elif defined(__linux__)
+			cpu_set_t cpuset;
+			CPU_ZERO(&cpuset);
+			CPU_SET(cpuCore, &cpuset);
+			return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset) == 0;
+#else
+			return false; // pinning is not supported on this platform, the thread still works unpinned
+#endif
+		}
+
+	private:
+		void Loop()
+		{
+			uint32_t seen = 0;
+
+			while (true)
+			{
+				int spins = 0;
+				while (requested.load(std::memory_order_acquire) == seen && running.load(std::memory_order_relaxed))
+				{
+					if (++spins < spinCount)
+					{
+						CLOUDSEED_CPU_RELAX();
+						continue;
+					}
+
+					// parked is set before checking for work, and Run adds work before checking parked,
+					// so either this check sees the job or Run sees parked and posts
+					parked = true;
+					if (requested.load() == seen && running.load())
+						wake.Wait();
+					else if (!parked.exchange(false))
+						wake.Wait(); // Run cleared parked in the meantime, take its post so it does not carry over
+					spins = 0;
+				}
+
+				if (!running.load())
+					break;
+
+				seen = requested.load(std::memory_order_acquire);
+				job(jobContext);
+				completed.store(seen, std::memory_order_release);
+			}
+		}
+	};
+}
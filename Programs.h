@@ -28,6 +28,10 @@ namespace Cloudseed
 {
 	float ProgramDarkPlate[Parameter::COUNT];
 
+	const int ProgramCount = 1;
+	float* Programs[ProgramCount] = { ProgramDarkPlate };
+	const char* ProgramNames[ProgramCount] = { "Dark Plate" };
+
 	void initPrograms()
 	{
 		ProgramDarkPlate[Parameter::DryOut] = 0.8705999851226807;
@@ -0,0 +1,688 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Benchmark harness for the reverb engine.
+// Renders white noise through every program and a matrix of heavier parameter settings,
+// across a range of block sizes and sample rates, and reports the cost of ReverbController::Process
+// as well as the cost of each stage inside ReverbChannel::Process.
+//
+// With -engine N, it instead renders N instances through a ReverbEngine with an increasing number of worker threads
+// and reports how the throughput scales with the core count.
+// -surround N does the same for one SurroundController with N channels, from 0 up to N - 1 worker threads.
+//
+// -decimate N runs the late lines at 1/N of the samplerate (2 or 4), 0 uses the suggested factor for each case.
+// -modupdate N updates the modulated delay times every N samples instead of 8.
+//
+// With -decaystress, it instead feeds half a second of noise into a short decay and then lets the tail ring out
+// for 8 seconds of silence, with and without denormals flushed to zero, and reports the block times as the tail decays.
+// -seedcheck renders every program and variation with the seed set before and after the parameters, and with Prepare
+// called before and after them, and fails unless every order gives identical output.
+// -statecheck saves the state of every program and variation halfway through a render, restores it into a fresh
+// instance, and fails unless the restored instance carries on with identical output, at late decimation 1, 2 and 4.
+// -nosquelch also turns off the input squelch for the cases that follow.
+// -double runs the cases in double precision, -int16 stores the delay history as 16 bit integers,
+// -half and -bf16 store it as 16 bit half precision or bfloat16 floats.
+//
+// Usage: CloudSeedBenchmark [-seconds N] [-csv file.csv] [-quick] [-parallel] [-decimate N] [-modupdate N] [-engine N]
+//                           [-surround N] [-decaystress] [-seedcheck] [-statecheck] [-nosquelch] [-double] [-int16] [-half]
+//                           [-bf16]
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "../DSP/ReverbController.h"
+#include "../DSP/ReverbEngine.h"
+#include "../DSP/SurroundController.h"
+#include "../DSP/LcgRandom.h"
+#include "../Programs.h"
+
+using namespace Cloudseed;
+
+struct ParamOverride
+{
+	int Param;
+	double Value;
+};
+
+struct Variation
+{
+	const char* Name;
+	int OverrideCount;
+	ParamOverride Overrides[12];
+};
+
+const Variation Variations[] =
+{
+	{ "Preset", 0, {} },
+	{ "MaxTaps", 2, { { Parameter::TapEnabled, 1.0 }, { Parameter::TapCount, 1.0 } } },
+	{ "MaxEarlyDiffusion", 2, { { Parameter::EarlyDiffuseEnabled, 1.0 }, { Parameter::EarlyDiffuseCount, 1.0 } } },
+	{ "MaxLateLines", 3, { { Parameter::LateLineCount, 1.0 }, { Parameter::LateDiffuseEnabled, 1.0 }, { Parameter::LateDiffuseCount, 1.0 } } },
+	{ "Everything", 12, {
+		{ Parameter::LowCutEnabled, 1.0 }, { Parameter::HighCutEnabled, 1.0 },
+		{ Parameter::TapEnabled, 1.0 }, { Parameter::TapCount, 1.0 },
+		{ Parameter::EarlyDiffuseEnabled, 1.0 }, { Parameter::EarlyDiffuseCount, 1.0 },
+		{ Parameter::LateLineCount, 1.0 }, { Parameter::LateDiffuseEnabled, 1.0 }, { Parameter::LateDiffuseCount, 1.0 },
+		{ Parameter::EqLowShelfEnabled, 1.0 }, { Parameter::EqHighShelfEnabled, 1.0 }, { Parameter::EqLowpassEnabled, 1.0 } } },
+};
+const int VariationCount = sizeof(Variations) / sizeof(Variations[0]);
+
+const int BlockSizes[] = { 32, 64, 128, 256, 512, 1024 };
+const int BlockSizeCount = sizeof(BlockSizes) / sizeof(BlockSizes[0]);
+
+const int Samplerates[] = { 44100, 48000, 96000, 192000 };
+const int SamplerateCount = sizeof(Samplerates) / sizeof(Samplerates[0]);
+
+const char* StageLabels[Stage::COUNT] =
+{
+	"InputFilters",
+	"PreDelay",
+	"Multitap",
+	"Diffuser",
+	"OutputMix",
+	"LateBank1", "LateBank2", "LateBank3", "LateBank4", "LateBank5", "LateBank6",
+	"LateBank7", "LateBank8", "LateBank9", "LateBank10", "LateBank11", "LateBank12",
+};
+
+struct BenchmarkResult
+{
+	double NanosPerSample;
+	double RealtimeFactor;
+	double WorstBlockMicros;
+	double BlockBudgetMicros;
+	double StageNanosPerSample[Stage::COUNT];
+};
+
+// T is the sample type, TStorage the delay storage type, see BasicReverbController
+template<typename T, typename TStorage>
+BenchmarkResult RunCase(float* program, const Variation& variation, int samplerate, int blockSize, double seconds, bool parallel, int decimation, int modulationUpdateRate, bool squelch)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::unique_ptr<BasicReverbController<T, TStorage>> reverb(new BasicReverbController<T, TStorage>(samplerate));
+	for (int i = 0; i < Parameter::COUNT; i++)
+		reverb->SetParameter(i, program[i]);
+	for (int i = 0; i < variation.OverrideCount; i++)
+		reverb->SetParameter(variation.Overrides[i].Param, variation.Overrides[i].Value);
+	reverb->SetSamplerate(samplerate);
+	reverb->Prepare(blockSize);
+	reverb->SetParallelProcessing(parallel);
+	reverb->SetLateDecimation(decimation > 0 ? decimation : reverb->GetSuggestedLateDecimation());
+	reverb->SetModulationUpdateRate(modulationUpdateRate);
+	reverb->SetInputSquelch(squelch);
+
+	// one second of noise, looped, keeps every stage busy for the whole measurement
+	std::vector<T> noiseL(samplerate);
+	std::vector<T> noiseR(samplerate);
+	LcgRandom rand(12345);
+	for (int i = 0; i < samplerate; i++)
+	{
+		noiseL[i] = 0.25f * (rand.NextFloat() * 2 - 1);
+		noiseR[i] = 0.25f * (rand.NextFloat() * 2 - 1);
+	}
+
+	std::vector<T> outL(blockSize);
+	std::vector<T> outR(blockSize);
+
+	int warmupBlocks = (samplerate / 4) / blockSize + 1;
+	int blockCount = (int)(seconds * samplerate / blockSize) + 1;
+	int readPos = 0;
+	double totalNanos = 0;
+	double worstNanos = 0;
+
+	for (int b = -warmupBlocks; b < blockCount; b++)
+	{
+		if (b == 0)
+		{
+			reverb->GetStageTimer(ChannelLR::Left).Reset();
+			reverb->GetStageTimer(ChannelLR::Right).Reset();
+		}
+
+		if (readPos + blockSize > samplerate)
+			readPos = 0;
+
+		auto start = Clock::now();
+		reverb->Process(&noiseL[readPos], &noiseR[readPos], &outL[0], &outR[0], blockSize);
+		auto end = Clock::now();
+		readPos += blockSize;
+
+		if (b < 0)
+			continue;
+
+		double nanos = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		totalNanos += nanos;
+		if (nanos > worstNanos)
+			worstNanos = nanos;
+	}
+
+	double totalSamples = (double)blockCount * blockSize;
+	double audioNanos = totalSamples / samplerate * 1e9;
+
+	BenchmarkResult result;
+	result.NanosPerSample = totalNanos / totalSamples;
+	result.RealtimeFactor = audioNanos / totalNanos;
+	result.WorstBlockMicros = worstNanos / 1000.0;
+	result.BlockBudgetMicros = blockSize * 1e6 / samplerate;
+	for (int i = 0; i < Stage::COUNT; i++)
+	{
+		double stageNanos = (double)reverb->GetStageTimer(ChannelLR::Left).GetNanos(i)
+			+ (double)reverb->GetStageTimer(ChannelLR::Right).GetNanos(i);
+		result.StageNanosPerSample[i] = stageNanos / totalSamples;
+	}
+
+	return result;
+}
+
+// Average block time over consecutive windows of a decaying tail, so a rising cost as the tail reaches
+// denormal levels shows up as a step in the table
+std::vector<double> RunDecayCase(float* program, bool flushDenormals, bool squelch, int windowBlocks)
+{
+	typedef std::chrono::steady_clock Clock;
+	const int samplerate = 48000;
+	const int blockSize = 256;
+
+	std::unique_ptr<ReverbController> reverb(new ReverbController(samplerate));
+	for (int i = 0; i < Parameter::COUNT; i++)
+		reverb->SetParameter(i, program[i]);
+	reverb->SetParameter(Parameter::LateLineDecay, 0.1); // about 100ms, the tail sinks into the denormal range within seconds
+	reverb->ClearBuffers();
+	reverb->SetFlushDenormals(flushDenormals);
+	reverb->SetInputSquelch(squelch);
+
+	std::vector<float> input(blockSize);
+	std::vector<float> outL(blockSize);
+	std::vector<float> outR(blockSize);
+	LcgRandom rand(12345);
+
+	int noiseBlocks = (samplerate / 2) / blockSize;
+	int blockCount = noiseBlocks + 8 * samplerate / blockSize;
+	std::vector<double> windows;
+	double windowNanos = 0;
+
+	for (int b = 0; b < blockCount; b++)
+	{
+		for (int i = 0; i < blockSize; i++)
+			input[i] = b < noiseBlocks ? 0.25f * (rand.NextFloat() * 2 - 1) : 0.0f;
+
+		auto start = Clock::now();
+		reverb->Process(&input[0], &input[0], &outL[0], &outR[0], blockSize);
+		auto end = Clock::now();
+		windowNanos += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+		if ((b + 1) % windowBlocks == 0)
+		{
+			windows.push_back(windowNanos / windowBlocks / 1000.0);
+			windowNanos = 0;
+		}
+	}
+
+	return windows;
+}
+
+void RunDecayStress(float* program, bool squelch)
+{
+	const int windowBlocks = 94; // about 500ms of 256 sample blocks at 48kHz
+	auto plain = RunDecayCase(program, false, squelch, windowBlocks);
+	auto flushed = RunDecayCase(program, true, squelch, windowBlocks);
+
+	printf("Noise for 0.5s, then silence. Average block time in us, 256 samples at 48kHz (budget 5333.3)\n");
+	printf("%-8s %14s %14s\n", "Time s", "denormals", "flush to zero");
+	for (size_t i = 0; i < plain.size() && i < flushed.size(); i++)
+		printf("%-8.2f %14.1f %14.1f\n", (i + 1) * windowBlocks * 256 / 48000.0, plain[i], flushed[i]);
+}
+
+// Renders a second of noise, with the seed passed to the constructor or set once the parameters are in place,
+// and Prepare called before or after the parameters
+std::vector<float> RenderSeeded(float* program, const Variation& variation, uint64_t seed, bool seedFirst, bool prepareFirst)
+{
+	const int samplerate = 48000;
+	const int blockSize = 256;
+
+	std::unique_ptr<ReverbController> reverb(seedFirst ? new ReverbController(samplerate, seed) : new ReverbController(samplerate));
+	if (prepareFirst)
+		reverb->Prepare(blockSize);
+	for (int i = 0; i < Parameter::COUNT; i++)
+		reverb->SetParameter(i, program[i]);
+	for (int i = 0; i < variation.OverrideCount; i++)
+		reverb->SetParameter(variation.Overrides[i].Param, variation.Overrides[i].Value);
+	if (!seedFirst)
+		reverb->SetSeed(seed);
+	if (!prepareFirst)
+		reverb->Prepare(blockSize);
+
+	std::vector<float> input(samplerate);
+	std::vector<float> output(samplerate * 2);
+	LcgRandom rand(12345);
+	for (int i = 0; i < samplerate; i++)
+		input[i] = 0.25f * (rand.NextFloat() * 2 - 1);
+
+	for (int i = 0; i < samplerate; i += blockSize)
+	{
+		int len = std::min(blockSize, samplerate - i);
+		reverb->Process(&input[i], &input[i], &output[i], &output[samplerate + i], len);
+	}
+	return output;
+}
+
+// Checks that the output depends only on the seed and the parameters, not on the order they, and the call to Prepare,
+// come in. Every order is compared to the seed first and Prepare last. Returns false if any case differs.
+bool RunSeedCheck()
+{
+	const uint64_t seeds[] = { 0, 1, 12345 };
+	bool passed = true;
+
+	printf("%-12s %-18s %8s %12s %12s %12s\n", "Program", "Variation", "Seed", "Seed last", "Prep first", "Both");
+	for (int p = 0; p < ProgramCount; p++)
+	{
+		for (int v = 0; v < VariationCount; v++)
+		{
+			for (auto seed : seeds)
+			{
+				auto reference = RenderSeeded(Programs[p], Variations[v], seed, true, false);
+				std::vector<float> others[] =
+				{
+					RenderSeeded(Programs[p], Variations[v], seed, false, false),
+					RenderSeeded(Programs[p], Variations[v], seed, true, true),
+					RenderSeeded(Programs[p], Variations[v], seed, false, true),
+				};
+
+				float maxDiff[3] = { 0, 0, 0 };
+				for (int k = 0; k < 3; k++)
+				{
+					for (size_t i = 0; i < reference.size(); i++)
+						maxDiff[k] = std::max(maxDiff[k], std::fabs(reference[i] - others[k][i]));
+					passed = passed && maxDiff[k] == 0;
+				}
+
+				printf("%-12s %-18s %8llu %12g %12g %12g\n", ProgramNames[p], Variations[v].Name, (unsigned long long)seed,
+					maxDiff[0], maxDiff[1], maxDiff[2]);
+			}
+		}
+	}
+
+	printf(passed ? "Seed check passed\n" : "Seed check FAILED\n");
+	return passed;
+}
+
+// Renders a second of noise, saves the state halfway and restores it into a fresh instance set up differently,
+// and returns the largest difference between the two instances over the rest of the second
+float RunStateCase(float* program, const Variation& variation, int decimation)
+{
+	const int samplerate = 48000;
+	const int blockSize = 256;
+	const int saveAt = blockSize * 94;
+
+	std::unique_ptr<ReverbController> saved(new ReverbController(samplerate, 1));
+	for (int i = 0; i < Parameter::COUNT; i++)
+		saved->SetParameter(i, program[i]);
+	for (int i = 0; i < variation.OverrideCount; i++)
+		saved->SetParameter(variation.Overrides[i].Param, variation.Overrides[i].Value);
+	saved->Prepare(blockSize);
+	saved->SetLateDecimation(decimation);
+
+	// the snapshot brings the parameters, samplerate and decimation along, nothing set up here may carry over
+	std::unique_ptr<ReverbController> restored(new ReverbController(44100, 2));
+	LcgRandom parameterRand(3);
+	for (int i = 0; i < Parameter::COUNT; i++)
+		restored->SetParameter(i, parameterRand.NextFloat());
+	restored->Prepare(blockSize);
+
+	std::vector<float> input(samplerate);
+	std::vector<float> savedL(blockSize), savedR(blockSize), restoredL(blockSize), restoredR(blockSize);
+	LcgRandom rand(12345);
+	for (int i = 0; i < samplerate; i++)
+		input[i] = 0.25f * (rand.NextFloat() * 2 - 1);
+
+	float maxDiff = 0;
+	for (int i = 0; i < samplerate; i += blockSize)
+	{
+		int len = std::min(blockSize, samplerate - i);
+		if (i == saveAt)
+		{
+			std::vector<uint8_t> data;
+			saved->SaveState(data);
+			if (!restored->RestoreState(data.data(), data.size()))
+				return INFINITY;
+		}
+
+		saved->Process(&input[i], &input[i], &savedL[0], &savedR[0], len);
+		if (i < saveAt)
+			continue;
+
+		restored->Process(&input[i], &input[i], &restoredL[0], &restoredR[0], len);
+		for (int k = 0; k < len; k++)
+			maxDiff = std::max(maxDiff, std::max(std::fabs(savedL[k] - restoredL[k]), std::fabs(savedR[k] - restoredR[k])));
+	}
+	return maxDiff;
+}
+
+// Checks that a restored snapshot carries on exactly where the saved instance left off. Returns false if any case differs.
+bool RunStateCheck()
+{
+	const int decimations[] = { 1, 2, 4 };
+	bool passed = true;
+
+	printf("%-12s %-18s %10s %12s\n", "Program", "Variation", "Decimation", "Max diff");
+	for (int p = 0; p < ProgramCount; p++)
+	{
+		for (int v = 0; v < VariationCount; v++)
+		{
+			for (auto decimation : decimations)
+			{
+				float maxDiff = RunStateCase(Programs[p], Variations[v], decimation);
+				passed = passed && maxDiff == 0;
+				printf("%-12s %-18s %10d %12g\n", ProgramNames[p], Variations[v].Name, decimation, maxDiff);
+			}
+		}
+	}
+
+	printf(passed ? "State check passed\n" : "State check FAILED\n");
+	return passed;
+}
+
+void RunEngineScaling(float* program, int instanceCount, double seconds)
+{
+	typedef std::chrono::steady_clock Clock;
+	const int samplerate = 48000;
+	const int blockSize = 256;
+
+	std::vector<float> noise(samplerate);
+	LcgRandom rand(12345);
+	for (int i = 0; i < samplerate; i++)
+		noise[i] = 0.25f * (rand.NextFloat() * 2 - 1);
+
+	std::vector<float> outputs(instanceCount * blockSize * 2);
+	std::vector<ReverbJob> jobs(instanceCount);
+
+	int maxWorkers = (int)std::thread::hardware_concurrency();
+	if (maxWorkers < 1)
+		maxWorkers = 1;
+
+	printf("%-10s %-8s %16s %12s %10s\n", "Instances", "Workers", "ns/inst-sample", "RT factor", "Speedup");
+	double singleWorkerNanos = 0;
+
+	for (int workers = 1; workers <= maxWorkers; workers *= 2)
+	{
+		ReverbEngine engine(samplerate, instanceCount, workers);
+		for (int n = 0; n < instanceCount; n++)
+		{
+			auto& reverb = engine.GetInstance(n);
+			for (int i = 0; i < Parameter::COUNT; i++)
+				reverb.SetParameter(i, program[i]);
+			reverb.Prepare(blockSize);
+		}
+
+		int blockCount = (int)(seconds * samplerate / blockSize) + 1;
+		int readPos = 0;
+		double totalNanos = 0;
+
+		for (int b = 0; b < blockCount; b++)
+		{
+			if (readPos + blockSize > samplerate)
+				readPos = 0;
+
+			for (int n = 0; n < instanceCount; n++)
+			{
+				jobs[n].Instance = n;
+				jobs[n].InL = &noise[readPos];
+				jobs[n].InR = &noise[readPos];
+				jobs[n].OutL = &outputs[n * blockSize * 2];
+				jobs[n].OutR = &outputs[n * blockSize * 2 + blockSize];
+				jobs[n].BufSize = blockSize;
+			}
+
+			auto start = Clock::now();
+			engine.ProcessBatch(&jobs[0], instanceCount);
+			auto end = Clock::now();
+			totalNanos += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			readPos += blockSize;
+		}
+
+		if (workers == 1)
+			singleWorkerNanos = totalNanos;
+
+		double instanceSamples = (double)blockCount * blockSize * instanceCount;
+		double audioNanos = (double)blockCount * blockSize / samplerate * 1e9;
+		printf("%-10d %-8d %16.1f %12.2f %10.2f\n", instanceCount, workers,
+			totalNanos / instanceSamples, audioNanos / totalNanos, singleWorkerNanos / totalNanos);
+	}
+}
+
+void RunSurroundScaling(float* program, int channelCount, double seconds)
+{
+	typedef std::chrono::steady_clock Clock;
+	const int samplerate = 48000;
+	const int blockSize = 256;
+
+	std::vector<float> noise(samplerate);
+	LcgRandom rand(12345);
+	for (int i = 0; i < samplerate; i++)
+		noise[i] = 0.25f * (rand.NextFloat() * 2 - 1);
+
+	std::vector<float> outputs(channelCount * blockSize);
+	std::vector<float*> inputPointers(channelCount);
+	std::vector<float*> outputPointers(channelCount);
+	for (int k = 0; k < channelCount; k++)
+		outputPointers[k] = &outputs[k * blockSize];
+
+	int maxWorkers = (int)std::thread::hardware_concurrency() - 1;
+	if (maxWorkers > channelCount - 1)
+		maxWorkers = channelCount - 1;
+
+	printf("%-10s %-8s %15s %12s %10s\n", "Channels", "Workers", "ns/chan-sample", "RT factor", "Speedup");
+	double noWorkerNanos = 0;
+
+	for (int workers = 0; workers <= maxWorkers; workers = workers == 0 ? 1 : workers * 2)
+	{
+		std::unique_ptr<SurroundController> reverb(new SurroundController(samplerate, channelCount));
+		for (int i = 0; i < Parameter::COUNT; i++)
+			reverb->SetParameter(i, program[i]);
+		reverb->Prepare(blockSize);
+		reverb->SetWorkerCount(workers);
+
+		int blockCount = (int)(seconds * samplerate / blockSize) + 1;
+		int readPos = 0;
+		double totalNanos = 0;
+
+		for (int b = 0; b < blockCount; b++)
+		{
+			if (readPos + blockSize > samplerate)
+				readPos = 0;
+
+			for (int k = 0; k < channelCount; k++)
+				inputPointers[k] = &noise[readPos];
+
+			auto start = Clock::now();
+			reverb->Process(&inputPointers[0], &outputPointers[0], blockSize);
+			auto end = Clock::now();
+			totalNanos += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			readPos += blockSize;
+		}
+
+		if (workers == 0)
+			noWorkerNanos = totalNanos;
+
+		double channelSamples = (double)blockCount * blockSize * channelCount;
+		double audioNanos = (double)blockCount * blockSize / samplerate * 1e9;
+		printf("%-10d %-8d %15.1f %12.2f %10.2f\n", channelCount, workers,
+			totalNanos / channelSamples, audioNanos / totalNanos, noWorkerNanos / totalNanos);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = 2.0;
+	bool quick = false;
+	bool parallel = false;
+	int decimation = 1;
+	int modulationUpdateRate = 8;
+	int engineInstances = 0;
+	int surroundChannels = 0;
+	bool decayStress = false;
+	bool seedCheck = false;
+	bool stateCheck = false;
+	bool squelch = true;
+	bool doublePrecision = false;
+	bool int16Storage = false;
+	bool halfStorage = false;
+	bool bfloat16Storage = false;
+	std::string csvPath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+			csvPath = argv[++i];
+		else if (strcmp(argv[i], "-quick") == 0)
+			quick = true;
+		else if (strcmp(argv[i], "-parallel") == 0)
+			parallel = true;
+		else if (strcmp(argv[i], "-decimate") == 0 && i + 1 < argc)
+			decimation = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-modupdate") == 0 && i + 1 < argc)
+			modulationUpdateRate = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc)
+			engineInstances = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-surround") == 0 && i + 1 < argc)
+			surroundChannels = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-decaystress") == 0)
+			decayStress = true;
+		else if (strcmp(argv[i], "-seedcheck") == 0)
+			seedCheck = true;
+		else if (strcmp(argv[i], "-statecheck") == 0)
+			stateCheck = true;
+		else if (strcmp(argv[i], "-nosquelch") == 0)
+			squelch = false;
+		else if (strcmp(argv[i], "-double") == 0)
+			doublePrecision = true;
+		else if (strcmp(argv[i], "-int16") == 0)
+			int16Storage = true;
+		else if (strcmp(argv[i], "-half") == 0)
+			halfStorage = true;
+		else if (strcmp(argv[i], "-bf16") == 0)
+			bfloat16Storage = true;
+		else
+		{
+			std::cout << "Usage: CloudSeedBenchmark [-seconds N] [-csv file.csv] [-quick] [-parallel] [-decimate N] [-modupdate N] [-engine N] [-surround N] [-decaystress] [-seedcheck] [-statecheck] [-nosquelch] [-double] [-int16] [-half] [-bf16]\n";
+			return 1;
+		}
+	}
+
+	initPrograms();
+
+	if (engineInstances > 0)
+	{
+		RunEngineScaling(Programs[0], engineInstances, seconds);
+		return 0;
+	}
+
+	if (surroundChannels > 0)
+	{
+		RunSurroundScaling(Programs[0], surroundChannels, seconds);
+		return 0;
+	}
+
+	if (decayStress)
+	{
+		RunDecayStress(Programs[0], squelch);
+		return 0;
+	}
+
+	if (seedCheck)
+		return RunSeedCheck() ? 0 : 1;
+
+	if (stateCheck)
+		return RunStateCheck() ? 0 : 1;
+
+	std::ofstream csv;
+	if (!csvPath.empty())
+	{
+		csv.open(csvPath, std::ios::out);
+		csv << "Program,Variation,Samplerate,BlockSize,NsPerSample,RealtimeFactor,WorstBlockUs,BlockBudgetUs";
+		for (int i = 0; i < Stage::COUNT; i++)
+			csv << "," << StageLabels[i] << "NsPerSample";
+		csv << "\n";
+	}
+
+	printf("%-12s %-18s %7s %6s %12s %10s %14s %14s\n",
+		"Program", "Variation", "Rate", "Block", "ns/sample", "RT factor", "worst blk us", "budget blk us");
+
+	for (int p = 0; p < ProgramCount; p++)
+	{
+		for (int v = 0; v < VariationCount; v++)
+		{
+			for (int s = 0; s < SamplerateCount; s++)
+			{
+				int samplerate = Samplerates[s];
+				if (quick && samplerate != 48000)
+					continue;
+
+				for (int b = 0; b < BlockSizeCount; b++)
+				{
+					int blockSize = BlockSizes[b];
+					if (quick && blockSize != 256)
+						continue;
+
+					auto run = doublePrecision ? &RunCase<double, double> : &RunCase<float, float>;
+					if (int16Storage)
+						run = doublePrecision ? &RunCase<double, int16_t> : &RunCase<float, int16_t>;
+					else if (halfStorage)
+						run = doublePrecision ? &RunCase<double, Half> : &RunCase<float, Half>;
+					else if (bfloat16Storage)
+						run = doublePrecision ? &RunCase<double, BFloat16> : &RunCase<float, BFloat16>;
+					auto result = run(Programs[p], Variations[v], samplerate, blockSize, seconds, parallel, decimation, modulationUpdateRate, squelch);
+
+					printf("%-12s %-18s %7d %6d %12.1f %10.1f %14.1f %14.1f\n",
+						ProgramNames[p], Variations[v].Name, samplerate, blockSize,
+						result.NanosPerSample, result.RealtimeFactor, result.WorstBlockMicros, result.BlockBudgetMicros);
+
+#ifdef CLOUDSEED_STAGE_TIMING
+					printf("    stages ns/sample:");
+					for (int i = 0; i < Stage::COUNT; i++)
+					{
+						if (result.StageNanosPerSample[i] > 0)
+							printf(" %s=%.1f", StageLabels[i], result.StageNanosPerSample[i]);
+					}
+					printf("\n");
+#endif
+
+					if (csv.is_open())
+					{
+						csv << ProgramNames[p] << "," << Variations[v].Name << "," << samplerate << "," << blockSize << ","
+							<< result.NanosPerSample << "," << result.RealtimeFactor << ","
+							<< result.WorstBlockMicros << "," << result.BlockBudgetMicros;
+						for (int i = 0; i < Stage::COUNT; i++)
+							csv << "," << result.StageNanosPerSample[i];
+						csv << "\n";
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,266 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Renders an audio file through the reverb.
+// The file is streamed in fixed size chunks, so memory use does not depend on its length. Reading, processing and
+// writing run on three threads and overlap: while one chunk is being processed, the next one is read and the previous
+// one is written. Once the input ends, the tail is rendered until the output stays below a threshold.
+//
+// Usage: CloudSeedRender input.wav output.wav [-program N] [-raw channels samplerate] [-bits 16|24|32]
+//        [-chunk frames] [-tail-threshold dB] [-max-tail seconds] [-parallel] [-seed N]
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "WavFile.h"
+#include "../DSP/ReverbController.h"
+#include "../Programs.h"
+
+using namespace Cloudseed;
+
+struct Chunk
+{
+	std::vector<float> InL, InR, OutL, OutR;
+	int Frames;
+	bool Last; // marks the end of the stream, carries no audio
+};
+
+// Blocking queue of chunk indices that connects two pipeline stages
+class ChunkQueue
+{
+private:
+	std::deque<int> items;
+	std::mutex mutex;
+	std::condition_variable signal;
+
+public:
+	void Push(int index)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			items.push_back(index);
+		}
+		signal.notify_one();
+	}
+
+	int Pop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		signal.wait(lock, [this] { return !items.empty(); });
+		int index = items.front();
+		items.pop_front();
+		return index;
+	}
+};
+
+// Two chunks in flight per stage boundary keeps every stage busy
+static const int ChunkCount = 4;
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: CloudSeedRender input.wav output.wav [-program N] [-raw channels samplerate] [-bits 16|24|32]\n"
+			<< "       [-chunk frames] [-tail-threshold dB] [-max-tail seconds] [-parallel] [-seed N]\n";
+		return 1;
+	}
+
+	const char* inputPath = argv[1];
+	const char* outputPath = argv[2];
+	int program = 0;
+	int rawChannels = 0;
+	int rawSamplerate = 0;
+	int bits = 32;
+	int chunkFrames = 4096;
+	float tailThresholdDb = -90;
+	float maxTailSeconds = 60;
+	bool parallel = false;
+	uint64_t seed = 0;
+
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-program") == 0 && i + 1 < argc)
+			program = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-raw") == 0 && i + 2 < argc)
+		{
+			rawChannels = atoi(argv[++i]);
+			rawSamplerate = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-bits") == 0 && i + 1 < argc)
+			bits = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc)
+			chunkFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-tail-threshold") == 0 && i + 1 < argc)
+			tailThresholdDb = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-max-tail") == 0 && i + 1 < argc)
+			maxTailSeconds = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-parallel") == 0)
+			parallel = true;
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], nullptr, 10);
+		else
+		{
+			std::cout << "Unknown argument " << argv[i] << "\n";
+			return 1;
+		}
+	}
+
+	if (program < 0 || program >= ProgramCount || chunkFrames < 1)
+	{
+		std::cout << "Invalid program or chunk size\n";
+		return 1;
+	}
+
+	WavReader reader;
+	bool opened = rawChannels > 0 ? reader.OpenRaw(inputPath, rawChannels, rawSamplerate) : reader.Open(inputPath);
+	if (!opened || reader.GetSamplerate() <= 0)
+	{
+		std::cout << "Could not open " << inputPath << "\n";
+		return 1;
+	}
+
+	int samplerate = reader.GetSamplerate();
+	WavWriter writer;
+	if (!writer.Open(outputPath, samplerate, bits))
+	{
+		std::cout << "Could not create " << outputPath << "\n";
+		return 1;
+	}
+
+	initPrograms();
+	std::unique_ptr<ReverbController> reverb(new ReverbController(samplerate, seed));
+	for (int i = 0; i < Parameter::COUNT; i++)
+		reverb->SetParameter(i, Programs[program][i]);
+	reverb->ClearBuffers();
+	reverb->SetParallelProcessing(parallel);
+
+	Chunk chunks[ChunkCount];
+	ChunkQueue freeChunks, readChunks, processedChunks;
+	for (int i = 0; i < ChunkCount; i++)
+	{
+		chunks[i].InL.resize(chunkFrames);
+		chunks[i].InR.resize(chunkFrames);
+		chunks[i].OutL.resize(chunkFrames);
+		chunks[i].OutR.resize(chunkFrames);
+		freeChunks.Push(i);
+	}
+
+	std::thread readThread([&]
+	{
+		while (true)
+		{
+			int index = freeChunks.Pop();
+			auto& chunk = chunks[index];
+			chunk.Frames = reader.Read(chunk.InL.data(), chunk.InR.data(), chunkFrames);
+			chunk.Last = chunk.Frames == 0;
+			readChunks.Push(index);
+			if (chunk.Last)
+				break;
+		}
+	});
+
+	bool writeFailed = false;
+	std::thread writeThread([&]
+	{
+		while (true)
+		{
+			int index = processedChunks.Pop();
+			auto& chunk = chunks[index];
+			if (chunk.Last)
+				break;
+			if (!writer.Write(chunk.OutL.data(), chunk.OutR.data(), chunk.Frames))
+				writeFailed = true;
+			freeChunks.Push(index);
+		}
+	});
+
+	auto process = [&](Chunk& chunk)
+	{
+		// Process splits the chunk into blocks of at most GetMaxBlockSize(), any chunk size works
+		reverb->Process(chunk.InL.data(), chunk.InR.data(), chunk.OutL.data(), chunk.OutR.data(), chunk.Frames);
+	};
+
+	uint64_t inputFrames = 0;
+	while (true)
+	{
+		int index = readChunks.Pop();
+		auto& chunk = chunks[index];
+		if (chunk.Last)
+		{
+			freeChunks.Push(index);
+			break;
+		}
+
+		process(chunk);
+		inputFrames += chunk.Frames;
+		processedChunks.Push(index);
+	}
+
+	// Render the tail with silent input until the output has stayed quiet for longer than the end of the input
+	// can take to come through the pre-delay, taps, diffusers and delay lines, plus a short while
+	float threshold = Utils::DB2Gainf(tailThresholdDb);
+	uint64_t maxTailFrames = (uint64_t)(maxTailSeconds * samplerate);
+	uint64_t quietFrames = 0;
+	uint64_t tailFrames = 0;
+	uint64_t holdFrames = (uint64_t)((reverb->GetDrainMillis() + 100) * 0.001 * samplerate);
+	while (tailFrames < maxTailFrames && quietFrames < holdFrames)
+	{
+		int index = freeChunks.Pop();
+		auto& chunk = chunks[index];
+		chunk.Frames = (int)std::min<uint64_t>(chunkFrames, maxTailFrames - tailFrames);
+		chunk.Last = false;
+		Utils::ZeroBuffer(chunk.InL.data(), chunk.Frames);
+		Utils::ZeroBuffer(chunk.InR.data(), chunk.Frames);
+		process(chunk);
+
+		auto peak = std::max(Utils::Peak(chunk.OutL.data(), chunk.Frames), Utils::Peak(chunk.OutR.data(), chunk.Frames));
+		quietFrames = peak < threshold ? quietFrames + chunk.Frames : 0;
+		tailFrames += chunk.Frames;
+		processedChunks.Push(index);
+	}
+
+	int endIndex = freeChunks.Pop();
+	chunks[endIndex].Last = true;
+	processedChunks.Push(endIndex);
+
+	readThread.join();
+	writeThread.join();
+	writer.Close();
+
+	if (writeFailed)
+	{
+		std::cout << "Error writing " << outputPath << "\n";
+		return 1;
+	}
+
+	printf("Rendered %.2fs of input and %.2fs of tail at %dHz\n",
+		inputFrames / (double)samplerate, tailFrames / (double)samplerate, samplerate);
+	return 0;
+}
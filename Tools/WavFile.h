@@ -0,0 +1,322 @@
+/*
+Copyright (c) 2024 Ghost Note Engineering Ltd
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Minimal streaming WAV reader and writer for the command line tools.
+// The reader accepts 16, 24 and 32 bit integer PCM and 32 bit float files, or headerless 32 bit float data.
+// Both work on interleaved frames and only ever hold the chunk they were asked for in memory.
+
+class WavReader
+{
+private:
+	FILE* file;
+	int channels;
+	int samplerate;
+	int bitsPerSample;
+	bool isFloat;
+	uint64_t framesLeft;
+	std::vector<uint8_t> raw;
+
+public:
+	WavReader()
+	{
+		file = nullptr;
+		channels = 0;
+		samplerate = 0;
+		bitsPerSample = 0;
+		isFloat = false;
+		framesLeft = 0;
+	}
+
+	~WavReader()
+	{
+		Close();
+	}
+
+	bool Open(const char* path)
+	{
+		file = fopen(path, "rb");
+		if (!file)
+			return false;
+
+		char riff[12];
+		if (fread(riff, 1, 12, file) != 12 || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0)
+			return Fail();
+
+		bool haveFormat = false;
+		while (true)
+		{
+			char id[4];
+			uint32_t size;
+			if (fread(id, 1, 4, file) != 4 || !ReadU32(size))
+				return Fail();
+
+			if (memcmp(id, "fmt ", 4) == 0)
+			{
+				uint8_t fmt[16];
+				if (size < 16 || fread(fmt, 1, 16, file) != 16)
+					return Fail();
+
+				int format = fmt[0] | (fmt[1] << 8);
+				channels = fmt[2] | (fmt[3] << 8);
+				samplerate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | (fmt[7] << 24);
+				bitsPerSample = fmt[14] | (fmt[15] << 8);
+				if (format == 0xFFFE && size >= 26) // WAVE_FORMAT_EXTENSIBLE, the real format is in the sub format GUID
+				{
+					uint8_t ext[10];
+					if (fread(ext, 1, 10, file) != 10)
+						return Fail();
+					format = ext[8] | (ext[9] << 8);
+					size -= 10;
+				}
+
+				isFloat = format == 3;
+				if ((format != 1 && format != 3) || channels < 1 || (isFloat && bitsPerSample != 32)
+					|| (!isFloat && bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32))
+					return Fail();
+
+				fseek(file, (size - 16 + 1) & ~1u, SEEK_CUR);
+				haveFormat = true;
+			}
+			else if (memcmp(id, "data", 4) == 0)
+			{
+				if (!haveFormat)
+					return Fail();
+				framesLeft = size / (channels * (bitsPerSample / 8));
+				return true;
+			}
+			else
+			{
+				fseek(file, (size + 1) & ~1u, SEEK_CUR);
+			}
+		}
+	}
+
+	// Headerless interleaved 32 bit float data
+	bool OpenRaw(const char* path, int channels, int samplerate)
+	{
+		file = fopen(path, "rb");
+		if (!file)
+			return false;
+
+		this->channels = channels;
+		this->samplerate = samplerate;
+		bitsPerSample = 32;
+		isFloat = true;
+		framesLeft = UINT64_MAX; // until the end of the file
+		return true;
+	}
+
+	void Close()
+	{
+		if (file)
+			fclose(file);
+		file = nullptr;
+	}
+
+	int GetChannels() { return channels; }
+	int GetSamplerate() { return samplerate; }
+
+	// Reads up to frameCount frames into left and right, mono files are copied to both, any channels beyond
+	// the second are ignored. Returns the number of frames read, 0 at the end of the file.
+	int Read(float* left, float* right, int frameCount)
+	{
+		if (framesLeft < (uint64_t)frameCount)
+			frameCount = (int)framesLeft;
+
+		int bytesPerSample = bitsPerSample / 8;
+		int frameBytes = bytesPerSample * channels;
+		raw.resize((size_t)frameCount * frameBytes);
+		int frames = (int)(fread(raw.data(), 1, raw.size(), file) / frameBytes);
+		framesLeft -= frames;
+
+		for (int i = 0; i < frames; i++)
+		{
+			const uint8_t* frame = &raw[(size_t)i * frameBytes];
+			left[i] = Decode(frame);
+			right[i] = channels > 1 ? Decode(frame + bytesPerSample) : left[i];
+		}
+
+		return frames;
+	}
+
+private:
+	bool Fail()
+	{
+		Close();
+		return false;
+	}
+
+	bool ReadU32(uint32_t& value)
+	{
+		uint8_t b[4];
+		if (fread(b, 1, 4, file) != 4)
+			return false;
+		value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+		return true;
+	}
+
+	float Decode(const uint8_t* p)
+	{
+		if (isFloat)
+		{
+			float value;
+			memcpy(&value, p, 4);
+			return value;
+		}
+		if (bitsPerSample == 16)
+			return (int16_t)(p[0] | (p[1] << 8)) / 32768.0f;
+		if (bitsPerSample == 24)
+			return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.0f;
+		return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)) / 2147483648.0f;
+	}
+};
+
+// Writes stereo files, 16 or 24 bit integer PCM or 32 bit float. The sizes in the header are filled in by Close.
+class WavWriter
+{
+private:
+	FILE* file;
+	int bitsPerSample;
+	uint64_t dataBytes;
+	std::vector<uint8_t> raw;
+
+public:
+	WavWriter()
+	{
+		file = nullptr;
+		bitsPerSample = 32;
+		dataBytes = 0;
+	}
+
+	~WavWriter()
+	{
+		Close();
+	}
+
+	bool Open(const char* path, int samplerate, int bitsPerSample)
+	{
+		if (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32)
+			return false;
+
+		file = fopen(path, "wb");
+		if (!file)
+			return false;
+
+		this->bitsPerSample = bitsPerSample;
+		dataBytes = 0;
+
+		int channels = 2;
+		int blockAlign = channels * bitsPerSample / 8;
+		uint8_t header[44];
+		memcpy(header, "RIFF", 4);
+		PutU32(header + 4, 0);
+		memcpy(header + 8, "WAVEfmt ", 8);
+		PutU32(header + 16, 16);
+		PutU16(header + 20, bitsPerSample == 32 ? 3 : 1);
+		PutU16(header + 22, channels);
+		PutU32(header + 24, samplerate);
+		PutU32(header + 28, samplerate * blockAlign);
+		PutU16(header + 32, blockAlign);
+		PutU16(header + 34, bitsPerSample);
+		memcpy(header + 36, "data", 4);
+		PutU32(header + 40, 0);
+		return fwrite(header, 1, 44, file) == 44;
+	}
+
+	bool Write(const float* left, const float* right, int frameCount)
+	{
+		int bytesPerSample = bitsPerSample / 8;
+		raw.resize((size_t)frameCount * 2 * bytesPerSample);
+		uint8_t* p = raw.data();
+		for (int i = 0; i < frameCount; i++)
+		{
+			Encode(left[i], p);
+			Encode(right[i], p + bytesPerSample);
+			p += 2 * bytesPerSample;
+		}
+
+		dataBytes += raw.size();
+		return fwrite(raw.data(), 1, raw.size(), file) == raw.size();
+	}
+
+	// Patches the header sizes. Files beyond 4GB get clamped sizes, which most readers treat as "read to the end"
+	void Close()
+	{
+		if (!file)
+			return;
+
+		uint32_t data = dataBytes > 0xFFFFFFFFull - 36 ? 0xFFFFFFFFu - 36 : (uint32_t)dataBytes;
+		uint8_t b[4];
+		fseek(file, 4, SEEK_SET);
+		PutU32(b, data + 36);
+		fwrite(b, 1, 4, file);
+		fseek(file, 40, SEEK_SET);
+		PutU32(b, data);
+		fwrite(b, 1, 4, file);
+		fclose(file);
+		file = nullptr;
+	}
+
+private:
+	static void PutU16(uint8_t* p, uint32_t value)
+	{
+		p[0] = value & 0xFF;
+		p[1] = (value >> 8) & 0xFF;
+	}
+
+	static void PutU32(uint8_t* p, uint32_t value)
+	{
+		PutU16(p, value & 0xFFFF);
+		PutU16(p + 2, value >> 16);
+	}
+
+	void Encode(float value, uint8_t* p)
+	{
+		if (bitsPerSample == 32)
+		{
+			memcpy(p, &value, 4);
+			return;
+		}
+
+		if (value > 1.0f) value = 1.0f;
+		if (value < -1.0f) value = -1.0f;
+		if (bitsPerSample == 16)
+		{
+			auto v = (int32_t)(value * 32767.0f);
+			PutU16(p, (uint16_t)v);
+		}
+		else
+		{
+			auto v = (int32_t)(value * 8388607.0f);
+			p[0] = v & 0xFF;
+			p[1] = (v >> 8) & 0xFF;
+			p[2] = (v >> 16) & 0xFF;
+		}
+	}
+};